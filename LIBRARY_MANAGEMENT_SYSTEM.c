@@ -1,39 +1,187 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <termios.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
-#define MAX_STREAMS 5
-#define MAX_SUBJECTS 5
-#define MAX_BOOKS 10
 #define PASSWORD_LENGTH 50
-#define MAX_STUDENTS 100
-#define MAX_ISSUED_BOOKS_PER_STUDENT 10
-#define MAX_LOGS 500
+#define DEFAULT_MAX_LOANS 10
+#define LEGACY_LOANS_PER_STUDENT 10    // loan slots in the fixed-size student layouts
 #define BORROW_DAYS 14
+#define DEFAULT_PICKUP_DAYS 3
 #define FINE_PER_DAY 5  
 #define TABLE_WIDTH 80
+#define CATALOG_FILE "books.csv"
+#define CATALOG_READ_CHUNK 65536
+#define CATALOG_MAX_LINE 1024
+#define CATALOG_FIELD_LENGTH 100
+#define CATALOG_MAX_BOOK_ID 16777215
+#define CATALOG_LOAD_BUDGET_MS 500.0
+#define CONFIG_FILE "library.conf"
+#define SALT_LENGTH 16
+#define HASH_LENGTH 32
+#define DEFAULT_KDF_ITERATIONS 100000
+#define DEFAULT_KDF_THREADS 2
+#define DEFAULT_LOAD_THREADS 4
+#define VERIFY_CACHE_SIZE 256
+#define VERIFY_CACHE_SECONDS 300
+#define STUDENTS_MAGIC_V2 0x32534d4c   // "LMS2": raw Student structs, hashed passwords
+#define STUDENTS_MAGIC_V3 0x33534d4c   // "LMS3": as LMS2 plus the journal sequence number
+#define LOGS_MAGIC_V2 0x32474f4c       // "LOG2": raw LogEntry structs
+#define STUDENT_FILE_MAGIC 0x53534d4c  // "LMSS"
+#define LOG_FILE_MAGIC 0x4c534d4c      // "LMSL"
+#define STUDENT_FORMAT_VERSION 4       // 3 had no holds; 1 and 2 had ten fixed loan slots; 1 stored titles
+#define LOG_FORMAT_VERSION 3           // version 1 had no sequence number, 2 stored titles
+#define DATA_HEADER_SIZE 64
+#define DISK_NAME_LENGTH 52
+#define DISK_TITLE_LENGTH 100
+#define DISK_ACTION_LENGTH 12
+#define DISK_LOAN_SIZE_V1 (4 * 4 + 8 * 3 + DISK_TITLE_LENGTH)
+#define DISK_LOAN_SIZE (4 * 2 + 8 * 3)
+#define DISK_HOLD_SIZE (4 * 2 + 8 * 2)
+#define DISK_STUDENT_HEAD (DISK_NAME_LENGTH + SALT_LENGTH + HASH_LENGTH + 4 + 4)
+#define DISK_STUDENT_SIZE_FOR(loanSize) (DISK_STUDENT_HEAD + LEGACY_LOANS_PER_STUDENT * (loanSize) + 4)
+#define DISK_STUDENT_SIZE_V1 DISK_STUDENT_SIZE_FOR(DISK_LOAN_SIZE_V1)
+#define DISK_STUDENT_SIZE_V2 DISK_STUDENT_SIZE_FOR(DISK_LOAN_SIZE)
+#define DISK_LOG_SIZE_V1 (4 + DISK_NAME_LENGTH + DISK_TITLE_LENGTH + DISK_ACTION_LENGTH + 8 + 4)
+#define DISK_LOG_SIZE_V2 (DISK_LOG_SIZE_V1 + 8)
+#define DISK_LOG_SIZE (4 + DISK_NAME_LENGTH + 4 + DISK_ACTION_LENGTH + 8 + 8 + 4)
+#define LOG_DIR "logs"
+#define LOG_SEGMENT_ENTRIES 1024
+#define REPORT_PAGE_SIZE 20
+#define STUDENT_LOCK_STRIPES 64
+#define HOLD_LOCK_STRIPES 64
+#define SERVER_DEFAULT_ADDRESS "7070"
+#define SERVER_INPUT_LENGTH 4096
+#define SERVER_MAX_RESULTS 50
+#define SERVER_MAX_EVENTS 256
+#define SERVER_SCRATCH_SIZE 4096
+#define JOURNAL_FILE "journal.dat"
+#define JOURNAL_MAX_RECORD 256
+#define JOURNAL_COMPACT_BYTES (1 << 20)
+#define JOURNAL_COMPACT_SECONDS 300
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define FUZZY_MAX_WORDS 8
+#define FUZZY_TOP_K 10
+#define METRIC_BUCKETS 24           // latency buckets: < 1us, < 2us, ... < 2^22us, then the rest
+#define METRICS_FILE "metrics.prom"
+#define DEFAULT_METRICS_INTERVAL 15 // seconds between rewrites of METRICS_FILE; 0 = never
 
+// Arenas hand out memory by bumping a pointer through large blocks and free
+// a whole region at once. Each kind of arena keeps running counts for the
+// stats command; arenas of one kind (one per session, say) share them.
 typedef struct {
-    char name[100];
-    int quantity;
-} Book;
+    const char *name;
+    uint64_t allocs;
+    uint64_t resets;        // regions freed at once
+    size_t used;            // bytes handed out and not yet freed
+    size_t peak;
+    size_t reserved;        // bytes held in blocks
+} ArenaStats;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size, used;
+    size_t pad;             // keeps data 16-byte aligned
+    unsigned char data[];
+} ArenaBlock;
 
 typedef struct {
-    char subject[100];
-    Book books[MAX_BOOKS];
-    int bookCount;
-} Subject;
+    ArenaBlock *head;       // block being filled; older blocks follow
+    void *last;             // latest allocation, which can grow in place
+    size_t used;
+    size_t blockSize;       // 0 = ARENA_BLOCK_SIZE
+    ArenaStats *stats;
+} Arena;
+
+// Hot-path metrics. Every thread counts into its own shard, which only that
+// thread writes, so recording an operation takes no lock; readers sum the
+// shards of all threads.
+enum { METRIC_ISSUE, METRIC_RETURN, METRIC_SEARCH, METRIC_FUZZY, METRIC_LOGIN, METRIC_COMMIT,
+       METRIC_SNAPSHOT, METRIC_LOAD_STUDENTS, METRIC_LOAD_CATALOG, METRIC_LOAD_LOGS, METRIC_BUILD_INDEX,
+       METRIC_OPS };
+enum { IO_JOURNAL, IO_STUDENTS, IO_LOGS, IO_CATALOG, IO_KINDS };
+
+typedef struct MetricShard {
+    uint64_t calls[METRIC_OPS];
+    uint64_t failed[METRIC_OPS];
+    uint64_t totalNs[METRIC_OPS];
+    uint64_t maxNs[METRIC_OPS];
+    uint64_t buckets[METRIC_OPS][METRIC_BUCKETS];
+    uint64_t bytesRead[IO_KINDS];
+    uint64_t bytesWritten[IO_KINDS];
+    struct MetricShard *next;
+} MetricShard;
+
+// Catalog storage: names live once in an interned string pool and books are
+// kept as parallel columns so scans only touch the fields they read.
+typedef struct {
+    char *data;
+    size_t size;
+    size_t cap;
+    uint32_t *slots;    // open-addressing table of (offset + 1), 0 = empty
+    size_t slotCap;
+    size_t count;
+} StringPool;
 
 typedef struct {
-    char streamName[100];
-    Subject subjects[MAX_SUBJECTS];
+    uint32_t nameOff;
+    int *subjectIds;
     int subjectCount;
+    int subjectCap;
 } Stream;
 
+typedef struct {
+    uint32_t nameOff;
+    int streamId;
+    int *bookIds;
+    int bookCount;
+    int bookCap;
+} Subject;
+
+typedef struct {
+    uint32_t bookId;
+    int isReturned;
+    time_t issueDate;
+    time_t dueDate;
+    time_t returnDate;
+    int dueHandle;      // entry in the due-date index while the book is out
+} IssuedBook;
+
+typedef struct {
+    uint32_t bookId;
+    int ready;          // a copy is set aside for pickup
+    uint64_t ticket;    // journal record that placed the hold; orders the queue
+    time_t time;        // when the hold was placed, or the pickup deadline once ready
+} StudentHold;
+
+// Loan layout of the raw-struct students.dat files, which referred to books
+// by catalog position and copied the title.
 typedef struct {
     int streamIndex;
     int subjectIndex;
@@ -43,38 +191,254 @@ typedef struct {
     time_t dueDate;
     time_t returnDate;
     int isReturned;
-} IssuedBook;
+} LegacyIssuedBook;
+
+typedef struct {
+    char username[50];
+    unsigned char salt[SALT_LENGTH];
+    unsigned char passwordHash[HASH_LENGTH];     // PBKDF2-HMAC-SHA256
+    uint32_t kdfIterations;
+    IssuedBook *loans;      // every loan in issue order; returned ones are history
+    int loanCount, loanCap;
+    int *active;            // numbers of the loans still out, unordered
+    int activeCount, activeCap;
+    StudentHold *holds;     // in the order they were placed; guarded by holdListLocks
+    int holdCount, holdCap;
+} Student;
 
+// students.dat layouts from before the versioned format; migrated on load.
 typedef struct {
     char username[50];
     char password[PASSWORD_LENGTH];
-    IssuedBook issuedBooks[MAX_ISSUED_BOOKS_PER_STUDENT];
+    LegacyIssuedBook issuedBooks[LEGACY_LOANS_PER_STUDENT];
     int issuedBookCount;
-} Student;
+} LegacyStudent;
+
+typedef struct {
+    char username[50];
+    unsigned char salt[SALT_LENGTH];
+    unsigned char passwordHash[HASH_LENGTH];
+    uint32_t kdfIterations;
+    LegacyIssuedBook issuedBooks[LEGACY_LOANS_PER_STUDENT];
+    int issuedBookCount;
+} LegacyHashedStudent;
+
+typedef struct {
+    int kdfIterations;
+    int kdfThreads;
+    int maxLoans;           // books a student may have out at once, and hold at once
+    int metricsInterval;
+    int pickupDays;         // how long a copy set aside for a hold waits
+    int loadThreads;        // workers that load files and build indexes
+} Config;
+
+// A password derivation queued for the KDF worker pool.
+typedef struct KdfJob {
+    const char *password;
+    const unsigned char *salt;
+    uint32_t iterations;
+    unsigned char out[HASH_LENGTH];
+    int done;
+    struct KdfJob *next;
+} KdfJob;
+
+// Work queued for the task pool.
+typedef struct Task {
+    void (*run)(void);
+    int done;
+    struct Task *next;
+} Task;
 
 typedef struct {
     int studentIndex;
     char username[50];
-    char bookName[100];
+    uint32_t bookId;
     char action[10];
     time_t timestamp;
+    uint64_t seq;       // journal record that produced this entry
 } LogEntry;
 
 typedef struct {
-    Stream streams[MAX_STREAMS];
-    int streamCount;
+    StringPool strings;
+    Stream *streams;
+    int streamCount, streamCap;
+    Subject *subjects;
+    int subjectCount, subjectCap;
+    // Book columns, indexed by catalog row
+    uint32_t *bookName;
+    int *bookSubject;
+    int *quantity;
+    uint32_t *bookId;       // stable id kept in books.csv, loans and logs; 0 = not yet assigned
+    int bookCount, bookCap;
+    int *titleSlots;        // open-addressing table of (row + 1) by exact title
+    int titleSlotCap;
+    int *rowById;           // (row + 1) indexed by book id, 0 = no such book
+    uint32_t rowByIdCap;
+    uint32_t nextBookId;
 } Library;
 
+// Inverted index over case-folded title, subject and stream tokens.
+typedef struct {
+    uint32_t termOff;
+    int *postings;      // ascending book ids
+    int count;
+    int cap;
+} PostingList;
+
+typedef struct {
+    uint32_t key;       // three bytes, '^' and '$' stored as 1 and 2
+    int *terms;         // ascending term ids
+    int count;
+    int cap;
+} TrigramList;
+
+typedef struct {
+    StringPool terms;
+    PostingList *lists;     // indexed by term id
+    int termCount, termCap;
+    int *slots;             // open-addressing table of (term id + 1)
+    int slotCap;
+    int *sorted;            // term ids in term order, for prefix lookups
+    int sortedCount;
+    // Trigrams of each term padded as "^term$", for fuzzy lookups
+    TrigramList *grams;
+    int gramCount, gramCap;
+    int *gramSlots;         // open-addressing table of (trigram id + 1)
+    int gramSlotCap;
+} SearchIndex;
+
+// A fuzzy search result: how many query words the book matched and the
+// summed edit distance of those matches.
+typedef struct {
+    int id;
+    int matched;
+    int distance;
+} FuzzyHit;
+
+Config config = { DEFAULT_KDF_ITERATIONS, DEFAULT_KDF_THREADS, DEFAULT_MAX_LOANS, DEFAULT_METRICS_INTERVAL, DEFAULT_PICKUP_DAYS,
+                  DEFAULT_LOAD_THREADS };
 Library lib;
+SearchIndex searchIdx;
+// Student directory: records grow on demand and are found by username through
+// an open-addressing hash index.
+typedef struct {
+    uint32_t hash;
+    int index;      // student index + 1, 0 = empty
+} StudentSlot;
+
 int studentCount = 0;
-Student students[MAX_STUDENTS];
-LogEntry logs[MAX_LOGS];
+int studentCap = 0;
+Student *students = NULL;
+StudentSlot *studentSlots = NULL;
+int studentSlotCap = 0;
+// A read-only data file mapped into memory; records are decoded on access.
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    const unsigned char *records;
+    uint64_t count;
+    uint32_t recordSize;
+    uint64_t seq;
+    uint64_t extra[3];  // format-specific header fields
+} MappedFile;
+
+// The transaction log is split into fixed-size segments. New entries go into
+// the active in-memory segment; a full segment is sealed and written to its
+// own file under logs/ by a background thread while a second, preallocated
+// buffer takes over, so appending never allocates.
+typedef struct {
+    LogEntry entries[LOG_SEGMENT_ENTRIES];
+    int count;
+    int number;
+} LogSegment;
+
+typedef struct {
+    int number;
+    int firstIndex;     // log index of the segment's first entry
+    int count;
+    time_t minTime, maxTime;
+    uint64_t lastSeq;
+} SegmentInfo;
+
 int logCount = 0;
 
+// Report index over the log: one timeline of all entries plus one per user
+// and per book title, each ordered by (timestamp, log index) so a date range
+// is two binary searches and a page is a contiguous slice.
+typedef struct {
+    time_t timestamp;
+    int logIndex;
+} TimelineEntry;
+
+typedef struct {
+    TimelineEntry *entries;
+    int count, cap;
+} Timeline;
+
+typedef struct {
+    int built;
+    Timeline all;
+    StringPool keys;        // "u:<username>" and "b:<title>", lower-cased
+    uint32_t *keyOffs;      // indexed by key id
+    Timeline *byKey;
+    int keyCount, keyCap;
+    int *slots;             // open-addressing table of (key id + 1)
+    int slotCap;
+} LogIndex;
+
+LogIndex logIdx;
+
+typedef struct {
+    time_t dueDate;
+    int student;
+    int slot;
+    int handle;
+} DueEntry;
+
+typedef struct {
+    DueEntry *heap;
+    int count, cap;
+    int *pos;               // heap index per handle
+    int posCap;
+    int *freeHandles;       // handles of returned loans, reused first
+    int freeCount;
+} DueIndex;
+
+DueIndex dueIdx;
+
+// Issues and returns hold the read side of stateLock plus the lock stripe of
+// their student, and take stock with a compare-and-swap on the book's
+// counter. Signups (which may move the students array) and journal
+// compaction (which needs a quiet point to snapshot) take the write side,
+// which is preferred so a steady stream of issues cannot starve it.
+// historyLock keeps journal records and log entries in the same order.
+// Titles somebody holds are also locked by a stripe of holdLocks, taken
+// after the student's and before historyLock (see Holds).
+pthread_rwlock_t stateLock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+pthread_mutex_t historyLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t studentLocks[STUDENT_LOCK_STRIPES] = {
+    [0 ... STUDENT_LOCK_STRIPES - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+static pthread_mutex_t holdLocks[HOLD_LOCK_STRIPES] = {
+    [0 ... HOLD_LOCK_STRIPES - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+static pthread_mutex_t holdListLocks[STUDENT_LOCK_STRIPES] = {
+    [0 ... STUDENT_LOCK_STRIPES - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+uint64_t studentsSeq = 0;   // last journal record folded into students.dat
+uint64_t logsSeq = 0;       // last journal record whose log entry is on disk
+
 // Helper functions declarations
+void *xrealloc(void *ptr, size_t size);
+void *arenaAlloc(Arena *a, size_t bytes);
+void *arenaGrow(Arena *a, void *p, size_t oldBytes, size_t newBytes);
+void arenaReset(Arena *a, int release);
 void clearInput();
 void waitForEnter();
+double nowMs();
 char *strcasestr_custom(const char *haystack, const char *needle);
+const char *findCaseInsensitive(const char *haystack, size_t hlen, const char *needle, size_t nlen);
+const char *substringKernelName();
 void getPassword(char* password, int maxLength);
 int isStrongPassword(const char* password);
 void printDate(time_t t);
@@ -82,43 +446,233 @@ void printHeader(const char *title);
 void printLine(int width);
 void printCenteredLine(const char *text, int width);
 
+// Configuration
+void loadConfig(const char *path);
+
+// Metrics
+uint64_t metricStart();
+void metricEnd(int op, uint64_t start, int ok);
+void metricIo(int kind, uint64_t bytesRead, uint64_t bytesWritten);
+void metricsCollect(MetricShard *out);
+void metricsWrite(FILE *fp);
+int metricsWriteFile(const char *path);
+void metricsStartDumper();
+void metricsSave();
+void metricsMenu();
+
+// Password hashing
+void sha256(const unsigned char *data, size_t len, unsigned char out[HASH_LENGTH]);
+void pbkdf2Sha256(const char *password, const unsigned char *salt, size_t saltLength,
+                  uint32_t iterations, unsigned char out[HASH_LENGTH]);
+void kdfStartPool(int threads);
+void kdfSubmit(KdfJob *job);
+void kdfWait(KdfJob *job);
+int kdfJobDone(KdfJob *job);
+void kdfSetNotify(int fd);
+
+// Task pool
+void taskStartPool(int threads);
+void taskSubmit(Task *task);
+void taskWait(Task *task);
+void catalogAwait();
+int randomSalt(unsigned char salt[SALT_LENGTH]);
+int hashNewPassword(const char *password, unsigned char salt[SALT_LENGTH],
+                    unsigned char hash[HASH_LENGTH], uint32_t *iterations);
+int setStudentPassword(int studentIndex, const char *password);
+int verifyStudentPassword(int studentIndex, const char *password);
+int verifyCacheCheck(int studentIndex, const char *password);
+void verifyCacheRemember(int studentIndex, const char *password);
+
 // Student management
-void saveStudents();
 void loadStudents();
+void reconcileInventory();
+int stockTake(int id);
+void stockGive(int id);
+int stockLevel(int id);
+void lockStudent(int studentIndex);
+void dueIndexAdd(int student, int slot, time_t dueDate);
+void dueIndexRemove(int student, int slot);
+int dueIndexOverdue(Arena *arena, time_t asOf, DueEntry **out, long long *totalFine);
+void unlockStudent(int studentIndex);
+int studentAddLoan(Student *st, const IssuedBook *loan);
+int studentActiveLoan(const Student *st, uint32_t bookId);
+void studentAddHold(Student *st, const StudentHold *hold);
+StudentHold *studentHold(const Student *st, uint32_t bookId);
+int studentHoldsCopy(int studentIndex, StudentHold **out);
+int applySignup(const char *username, const unsigned char *salt, const unsigned char *hash, uint32_t iterations);
+int applyIssue(int studentIndex, uint32_t bookId, time_t issueDate, time_t dueDate);
+int applyReturn(int studentIndex, int slot, time_t returnDate);
+static void holdPassCopy(uint32_t bookId, time_t when);
+static int holdClaim(int studentIndex, uint32_t bookId);
+int applyHoldPlace(int studentIndex, uint32_t bookId, time_t placed, uint64_t ticket);
+int applyHoldCancel(int studentIndex, uint32_t bookId, time_t when);
+void holdReserve(int id);
+void rebuildHoldQueues();
+int holdPosition(int studentIndex, uint32_t bookId);
+int holdWaiting(uint32_t bookId);
+
+// Journal
+uint32_t crc32(const unsigned char *data, size_t len);
+int replayJournal();
+void journalOpen();
+uint64_t journalSignup(int studentIndex);
+uint64_t journalIssue(int studentIndex, int slot);
+uint64_t journalReturn(int studentIndex, int slot);
+uint64_t journalHold(int type, int studentIndex, uint32_t bookId, time_t when);
+int journalCommit(uint64_t seq);
+void journalCommitOrWarn(uint64_t seq);
+uint64_t journalDurableSequence(int *failed);
+void journalSetNotify(int fd);
+void compactJournal();
+void compactJournalIfLarge();
+int findStudent(const char *username);
+int addStudent(const char *username);
+void rebuildStudentIndex();
 int usernameExists(const char* username);
 int validateStudentLogin(const char* username, const char* password);
+int validateAdminLogin(const char* username, const char* password);
 void signup();
 int studentLogin();
 
+// Catalog storage
+static uint32_t hashString(const char *str);
+uint32_t poolIntern(StringPool *pool, const char *str);
+int poolFind(const StringPool *pool, const char *str, uint32_t *off);
+const char *poolStr(const StringPool *pool, uint32_t off);
+int catalogAddStream(const char *name);
+int catalogAddSubject(int streamId, const char *name);
+int catalogAddBook(int subjectId, const char *name, int quantity, uint32_t bookId);
+int catalogAssignIds();
+int catalogRowById(uint32_t bookId);
+int catalogBookAt(int s, int sub, int b);
+int catalogFindBook(const char *name);
+const char *streamName(int streamId);
+const char *subjectName(int subjectId);
+const char *bookName(int id);
+const char *bookNameById(uint32_t bookId);
+
+// Search index
+int nextToken(const char **text, char *token, int maxLength);
+void indexAddBook(int bookId);
+void searchIndexDefer();
+int searchIndexDeferred();
+void searchIndexBuild();
+int searchIndexQuery(Arena *arena, const char *query, int **results);
+int searchIndexFuzzy(Arena *arena, const char *query, int limit, FuzzyHit **hits);
+
+// Catalog file loading
+int parseCatalogLine(char *line, char **fields, int maxFields);
+typedef int (*CatalogRowHandler)(void *ctx, char **fields, int quantity, uint32_t bookId);
+int readCatalogFile(const char *path, CatalogRowHandler handler, void *ctx, int *errorCount);
+int loadCatalogFile(const char *path, int *errorCount);
+
+// Browse view
+typedef struct BrowseView BrowseView;
+void browseMarkLayout();
+void browseMarkStock(int id);
+const BrowseView *browseAcquire();
+void browseRelease(const BrowseView *view);
+
 // Book and Library functions
 void loadBooks();
+void startupLoad();
+void startupIndexes();
+void printBookRow(const BrowseView *view, int id);
 void displayBooks();
 void searchBook();
 void filterBooksByStreamAndSubject();
+void addBookMenu();
+int issueCopy(int studentIndex, int id, uint64_t *seq);
+int returnCopy(int studentIndex, int slot, uint64_t *seq);
+const char *placeHold(int studentIndex, int id, uint64_t *seq);
+int cancelHold(int studentIndex, int id, uint64_t *seq);
 void issueBook(int loggedInStudentIndex);
 void returnBook(int loggedInStudentIndex);
 void showIssuedBooksByStudent(int studentIndex);
+void showHolds(int studentIndex);
 int calculateFine(time_t dueDate, time_t returnDate);
 
 // Logs
-void addLog(int studentIndex, const char* username, const char* bookName, const char* action);
+void loadLogStore();
+int readLog(int i, LogEntry *out);
+void buildLogIndex();
+void addLog(int studentIndex, const char* username, uint32_t bookId, const char* action,
+            time_t timestamp, uint64_t seq);
 void adminReportMenu();
+void overdueReportMenu();
 
 // Menus
 void adminMenu();
 void studentMenu(int loggedInStudentIndex);
 void loginSystem();
 
-int main() {
-    loadBooks();
-    loadStudents();
+// Benchmarks
+int runBenchmark(int argc, char *argv[]);
+int benchCatalogLoad(int titles);
+int benchSubstring(int titles);
+int benchLogin(int maxStudents);
+int benchKdf(int threads);
+int benchServer(const char *address, int connections, int requests, const char *request);
+int benchStress(int threads, int copies, int opsPerThread);
+int benchSuite(int titles, int studentTotal, int logs, int json);
+int runServer(const char *address);
+int runBatch(const char *path);
+typedef struct CliCommand CliCommand;
+const CliCommand *findCliCommand(const char *name);
+int runCliCommand(const CliCommand *cmd, int argc, char **args);
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        loadConfig(CONFIG_FILE);
+        return runBenchmark(argc - 2, argv + 2);
+    }
+
+    int serve = argc > 1 && strcmp(argv[1], "serve") == 0;
+    int batch = argc > 2 && strcmp(argv[1], "batch") == 0;
+    const CliCommand *command = argc > 1 ? findCliCommand(argv[1]) : NULL;
+    loadConfig(CONFIG_FILE);
+    kdfStartPool(config.kdfThreads);
+    startupLoad();
+    replayJournal();
+    journalOpen();
+    if (!command) startupIndexes();
+    if (serve) {
+        metricsStartDumper();
+        int rc = runServer(argc > 2 ? argv[2] : SERVER_DEFAULT_ADDRESS);
+        compactJournal();
+        metricsSave();
+        return rc;
+    }
+    if (batch) {
+        metricsStartDumper();
+        int rc = runBatch(argv[2]);
+        compactJournal();
+        metricsSave();
+        return rc;
+    }
+    if (command) {
+        int rc = runCliCommand(command, argc - 2, argv + 2);
+        compactJournalIfLarge();
+        return rc;
+    }
+    metricsStartDumper();
     loginSystem();
-    saveStudents();
+    compactJournal();
+    metricsSave();
     printf("\nThanks for using Library Management System!\n");
     return 0;
 }
 
 // --- Helper functions ---
+void *xrealloc(void *ptr, size_t size) {
+    void *p = realloc(ptr, size);
+    if (!p && size) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
 void clearInput() {
     int c;
     while ((c = getchar()) != '\n' && c != EOF);
@@ -129,6 +683,12 @@ void waitForEnter() {
     clearInput();
 }
 
+double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
 void printLine(int width) {
     for (int i = 0; i < width; i++) putchar('=');
     putchar('\n');
@@ -145,28 +705,391 @@ void printCenteredLine(const char *text, int width) {
 }
 
 void printHeader(const char *title) {
-    system("clear");
+    // Clear with an escape sequence rather than forking clear(1).
+    if (isatty(STDOUT_FILENO)) fputs("\033[H\033[2J\033[3J", stdout);
     printLine(TABLE_WIDTH);
     printCenteredLine(title, TABLE_WIDTH);
     printLine(TABLE_WIDTH);
 }
 
-char *strcasestr_custom(const char *haystack, const char *needle) {
-    if (!*needle) return (char *) haystack;
-    for (; *haystack; haystack++) {
-        if (tolower((unsigned char)*haystack) == tolower((unsigned char)*needle)) {
-            const char *h, *n;
-            for (h = haystack, n = needle; *h && *n; h++, n++) {
-                if (tolower((unsigned char)*h) != tolower((unsigned char)*n))
-                    break;
-            }
-            if (!*n)
-                return (char *) haystack;
+// --- Arenas ---
+// Not thread-safe: an arena belongs to one thread or is used under its
+// owner's lock.
+ArenaStats arenaStats[] = {
+    { .name = "catalog" }, { .name = "log index" }, { .name = "report" }, { .name = "session" }
+};
+enum { ARENA_CATALOG, ARENA_LOG_INDEX, ARENA_REPORT, ARENA_SESSION, ARENA_KINDS };
+Arena catalogArena = { .stats = &arenaStats[ARENA_CATALOG] };       // per-stream, per-subject and per-term lists
+Arena logIndexArena = { .stats = &arenaStats[ARENA_LOG_INDEX] };    // report timelines; guarded by historyLock
+Arena reportArena = { .stats = &arenaStats[ARENA_REPORT] };         // results of one menu or command report
+
+static void arenaCount(Arena *a, long long delta) {
+    a->used += (size_t)delta;
+    a->stats->used += (size_t)delta;
+    if (a->stats->used > a->stats->peak) a->stats->peak = a->stats->used;
+}
+
+void *arenaAlloc(Arena *a, size_t bytes) {
+    bytes = (bytes + 15) & ~(size_t)15;
+    ArenaBlock *b = a->head;
+    if (!b || b->size - b->used < bytes) {
+        size_t size = a->blockSize ? a->blockSize : ARENA_BLOCK_SIZE;
+        if (bytes > size) size = bytes;
+        b = xrealloc(NULL, sizeof(ArenaBlock) + size);
+        b->size = size;
+        b->used = 0;
+        b->next = a->head;
+        a->head = b;
+        a->stats->reserved += size;
+    }
+    void *p = b->data + b->used;
+    b->used += bytes;
+    a->last = p;
+    a->stats->allocs++;
+    arenaCount(a, (long long)bytes);
+    return p;
+}
+
+// Resizes p, the arena's latest allocation if possible: that one grows in
+// place, anything else is copied and its old space stays until the reset.
+void *arenaGrow(Arena *a, void *p, size_t oldBytes, size_t newBytes) {
+    ArenaBlock *b = a->head;
+    oldBytes = (oldBytes + 15) & ~(size_t)15;
+    if (p && p == a->last && b->size - b->used + oldBytes >= newBytes) {
+        newBytes = (newBytes + 15) & ~(size_t)15;
+        b->used = b->used - oldBytes + newBytes;
+        arenaCount(a, (long long)newBytes - (long long)oldBytes);
+        return p;
+    }
+    void *q = arenaAlloc(a, newBytes);
+    if (p) memcpy(q, p, oldBytes < newBytes ? oldBytes : newBytes);
+    return q;
+}
+
+// Frees everything allocated from the arena. The newest block is kept for
+// reuse unless 'release' is set or it was sized for one oversized request.
+void arenaReset(Arena *a, int release) {
+    size_t blockSize = a->blockSize ? a->blockSize : ARENA_BLOCK_SIZE;
+    ArenaBlock *keep = release || !a->head || a->head->size != blockSize ? NULL : a->head;
+    ArenaBlock *b = keep ? keep->next : a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        a->stats->reserved -= b->size;
+        free(b);
+        b = next;
+    }
+    if (keep) {
+        keep->used = 0;
+        keep->next = NULL;
+    }
+    a->head = keep;
+    a->last = NULL;
+    if (a->used) a->stats->resets++;
+    arenaCount(a, -(long long)a->used);
+}
+
+// --- Metrics ---
+static const char *metricOpNames[METRIC_OPS] = {
+    "issue", "return", "search", "fuzzy", "login", "commit", "snapshot", "load_students", "load_catalog",
+    "load_logs", "build_index"
+};
+static const char *ioKindNames[IO_KINDS] = { "journal", "students", "logs", "catalog" };
+static __thread MetricShard *metricShard;
+static MetricShard *metricShards;       // every thread's shard; never freed
+static pthread_mutex_t metricShardLock = PTHREAD_MUTEX_INITIALIZER;
+
+static MetricShard *metricLocalShard() {
+    MetricShard *s = metricShard;
+    if (!s) {
+        s = xrealloc(NULL, sizeof(*s));
+        memset(s, 0, sizeof(*s));
+        pthread_mutex_lock(&metricShardLock);
+        s->next = metricShards;
+        metricShards = s;
+        pthread_mutex_unlock(&metricShardLock);
+        metricShard = s;
+    }
+    return s;
+}
+
+// Only the owning thread writes a shard, so a plain add published with a
+// relaxed store is enough for readers to never see a torn value.
+static void metricAdd(uint64_t *counter, uint64_t v) {
+    __atomic_store_n(counter, *counter + v, __ATOMIC_RELAXED);
+}
+
+static uint64_t metricLoad(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Returns a timestamp in nanoseconds for metricEnd.
+uint64_t metricStart() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void metricEnd(int op, uint64_t start, int ok) {
+    uint64_t ns = metricStart() - start, us = ns / 1000;
+    int b = us ? 64 - __builtin_clzll(us) : 0;
+    if (b >= METRIC_BUCKETS) b = METRIC_BUCKETS - 1;
+    MetricShard *s = metricLocalShard();
+    metricAdd(&s->calls[op], 1);
+    if (!ok) metricAdd(&s->failed[op], 1);
+    metricAdd(&s->totalNs[op], ns);
+    metricAdd(&s->buckets[op][b], 1);
+    if (ns > s->maxNs[op]) __atomic_store_n(&s->maxNs[op], ns, __ATOMIC_RELAXED);
+}
+
+void metricIo(int kind, uint64_t bytesRead, uint64_t bytesWritten) {
+    MetricShard *s = metricLocalShard();
+    if (bytesRead) metricAdd(&s->bytesRead[kind], bytesRead);
+    if (bytesWritten) metricAdd(&s->bytesWritten[kind], bytesWritten);
+}
+
+// Sums the shards of all threads; max is the largest of any thread.
+void metricsCollect(MetricShard *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&metricShardLock);
+    for (const MetricShard *s = metricShards; s; s = s->next) {
+        for (int op = 0; op < METRIC_OPS; op++) {
+            out->calls[op] += metricLoad(&s->calls[op]);
+            out->failed[op] += metricLoad(&s->failed[op]);
+            out->totalNs[op] += metricLoad(&s->totalNs[op]);
+            uint64_t max = metricLoad(&s->maxNs[op]);
+            if (max > out->maxNs[op]) out->maxNs[op] = max;
+            for (int b = 0; b < METRIC_BUCKETS; b++) out->buckets[op][b] += metricLoad(&s->buckets[op][b]);
+        }
+        for (int k = 0; k < IO_KINDS; k++) {
+            out->bytesRead[k] += metricLoad(&s->bytesRead[k]);
+            out->bytesWritten[k] += metricLoad(&s->bytesWritten[k]);
+        }
+    }
+    pthread_mutex_unlock(&metricShardLock);
+}
+
+// Upper bound of the bucket holding quantile q (capped at the maximum), in
+// microseconds.
+static double metricQuantileUs(const MetricShard *m, int op, double q) {
+    uint64_t rank = (uint64_t)(q * (double)m->calls[op]), seen = 0;
+    double max = m->maxNs[op] / 1000.0;
+    for (int b = 0; b < METRIC_BUCKETS - 1; b++) {
+        seen += m->buckets[op][b];
+        if (seen > rank) return (double)(1u << b) < max ? (double)(1u << b) : max;
+    }
+    return max;
+}
+
+// Prometheus text exposition format.
+void metricsWrite(FILE *fp) {
+    MetricShard m;
+    metricsCollect(&m);
+    fprintf(fp, "# HELP library_operations_total Library operations by outcome.\n"
+                "# TYPE library_operations_total counter\n");
+    for (int op = 0; op < METRIC_OPS; op++) {
+        fprintf(fp, "library_operations_total{op=\"%s\",outcome=\"ok\"} %llu\n", metricOpNames[op],
+                (unsigned long long)(m.calls[op] - m.failed[op]));
+        fprintf(fp, "library_operations_total{op=\"%s\",outcome=\"failed\"} %llu\n", metricOpNames[op],
+                (unsigned long long)m.failed[op]);
+    }
+    fprintf(fp, "# HELP library_operation_duration_seconds Time spent in library operations.\n"
+                "# TYPE library_operation_duration_seconds histogram\n");
+    for (int op = 0; op < METRIC_OPS; op++) {
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRIC_BUCKETS - 1; b++) {
+            cumulative += m.buckets[op][b];
+            fprintf(fp, "library_operation_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n",
+                    metricOpNames[op], (double)(1u << b) / 1e6, (unsigned long long)cumulative);
         }
+        fprintf(fp, "library_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+                metricOpNames[op], (unsigned long long)m.calls[op]);
+        fprintf(fp, "library_operation_duration_seconds_sum{op=\"%s\"} %.9f\n", metricOpNames[op], m.totalNs[op] / 1e9);
+        fprintf(fp, "library_operation_duration_seconds_count{op=\"%s\"} %llu\n", metricOpNames[op],
+                (unsigned long long)m.calls[op]);
+    }
+    fprintf(fp, "# HELP library_operation_max_seconds Slowest single operation since startup.\n"
+                "# TYPE library_operation_max_seconds gauge\n");
+    for (int op = 0; op < METRIC_OPS; op++)
+        fprintf(fp, "library_operation_max_seconds{op=\"%s\"} %.9f\n", metricOpNames[op], m.maxNs[op] / 1e9);
+    fprintf(fp, "# HELP library_io_bytes_total Bytes read and written per data file.\n"
+                "# TYPE library_io_bytes_total counter\n");
+    for (int k = 0; k < IO_KINDS; k++) {
+        fprintf(fp, "library_io_bytes_total{file=\"%s\",direction=\"read\"} %llu\n", ioKindNames[k],
+                (unsigned long long)m.bytesRead[k]);
+        fprintf(fp, "library_io_bytes_total{file=\"%s\",direction=\"write\"} %llu\n", ioKindNames[k],
+                (unsigned long long)m.bytesWritten[k]);
+    }
+}
+
+// Replaces path atomically so a scraper never reads a half-written file. The
+// temporary name carries the pid, so two processes never write the same one.
+int metricsWriteFile(const char *path) {
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return -1;
+    metricsWrite(fp);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static pthread_mutex_t metricsDumpLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t metricsDumpWake = PTHREAD_COND_INITIALIZER;
+static pthread_t metricsDumpThread;
+static int metricsDumping = 0, metricsDumpStop = 0;
+
+static void *metricsDumper(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&metricsDumpLock);
+    while (!metricsDumpStop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += config.metricsInterval;
+        int rc = 0;
+        while (!metricsDumpStop && rc != ETIMEDOUT)
+            rc = pthread_cond_timedwait(&metricsDumpWake, &metricsDumpLock, &deadline);
+        if (metricsDumpStop) break;
+        pthread_mutex_unlock(&metricsDumpLock);
+        if (metricsWriteFile(METRICS_FILE) != 0) perror(METRICS_FILE);
+        pthread_mutex_lock(&metricsDumpLock);
+    }
+    pthread_mutex_unlock(&metricsDumpLock);
+    return NULL;
+}
+
+void metricsStartDumper() {
+    if (config.metricsInterval <= 0) return;
+    metricsDumping = pthread_create(&metricsDumpThread, NULL, metricsDumper, NULL) == 0;
+}
+
+// Final dump on the way out, so the file matches what the process did. The
+// dumper is stopped first so the two never write at once.
+void metricsSave() {
+    if (metricsDumping) {
+        pthread_mutex_lock(&metricsDumpLock);
+        metricsDumpStop = 1;
+        pthread_cond_signal(&metricsDumpWake);
+        pthread_mutex_unlock(&metricsDumpLock);
+        pthread_join(metricsDumpThread, NULL);
+        metricsDumping = 0;
+    }
+    if (config.metricsInterval > 0 && metricsWriteFile(METRICS_FILE) != 0) perror(METRICS_FILE);
+}
+
+// --- Case-insensitive substring search ---
+// Candidates are found by comparing the needle's first and last byte (in both
+// cases) against a whole vector of haystack positions at once; only positions
+// where both match are verified byte by byte. The widest kernel the CPU
+// supports is picked on first use.
+typedef const char *(*SubstringKernel)(const char *, size_t, const char *, size_t);
+
+static unsigned char foldTable[256];
+
+static int equalFolded(const char *a, const char *b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (foldTable[(unsigned char)a[i]] != foldTable[(unsigned char)b[i]])
+            return 0;
+    }
+    return 1;
+}
+
+static const char *findScalar(const char *h, size_t hlen, const char *n, size_t nlen) {
+    unsigned char first = foldTable[(unsigned char)n[0]];
+    unsigned char last = foldTable[(unsigned char)n[nlen - 1]];
+    for (size_t i = 0; i + nlen <= hlen; i++) {
+        if (foldTable[(unsigned char)h[i]] == first &&
+            foldTable[(unsigned char)h[i + nlen - 1]] == last &&
+            equalFolded(h + i + 1, n + 1, nlen - 1))
+            return h + i;
     }
     return NULL;
 }
 
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static const char *findSse2(const char *h, size_t hlen, const char *n, size_t nlen) {
+    const __m128i firstLo = _mm_set1_epi8((char)tolower((unsigned char)n[0]));
+    const __m128i firstUp = _mm_set1_epi8((char)toupper((unsigned char)n[0]));
+    const __m128i lastLo = _mm_set1_epi8((char)tolower((unsigned char)n[nlen - 1]));
+    const __m128i lastUp = _mm_set1_epi8((char)toupper((unsigned char)n[nlen - 1]));
+    size_t i = 0;
+    for (; i + nlen - 1 + 16 <= hlen; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(h + i));
+        __m128i z = _mm_loadu_si128((const __m128i *)(h + i + nlen - 1));
+        __m128i ma = _mm_or_si128(_mm_cmpeq_epi8(a, firstLo), _mm_cmpeq_epi8(a, firstUp));
+        __m128i mz = _mm_or_si128(_mm_cmpeq_epi8(z, lastLo), _mm_cmpeq_epi8(z, lastUp));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(ma, mz));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (equalFolded(h + i + bit + 1, n + 1, nlen - 1))
+                return h + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(h + i, hlen - i, n, nlen);
+}
+
+__attribute__((target("avx2")))
+static const char *findAvx2(const char *h, size_t hlen, const char *n, size_t nlen) {
+    const __m256i firstLo = _mm256_set1_epi8((char)tolower((unsigned char)n[0]));
+    const __m256i firstUp = _mm256_set1_epi8((char)toupper((unsigned char)n[0]));
+    const __m256i lastLo = _mm256_set1_epi8((char)tolower((unsigned char)n[nlen - 1]));
+    const __m256i lastUp = _mm256_set1_epi8((char)toupper((unsigned char)n[nlen - 1]));
+    size_t i = 0;
+    for (; i + nlen - 1 + 32 <= hlen; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(h + i));
+        __m256i z = _mm256_loadu_si256((const __m256i *)(h + i + nlen - 1));
+        __m256i ma = _mm256_or_si256(_mm256_cmpeq_epi8(a, firstLo), _mm256_cmpeq_epi8(a, firstUp));
+        __m256i mz = _mm256_or_si256(_mm256_cmpeq_epi8(z, lastLo), _mm256_cmpeq_epi8(z, lastUp));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(ma, mz));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (equalFolded(h + i + bit + 1, n + 1, nlen - 1))
+                return h + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findSse2(h + i, hlen - i, n, nlen);
+}
+#endif
+
+static SubstringKernel substringKernel;
+static const char *substringKernelLabel = "scalar";
+
+static void selectSubstringKernel() {
+    for (int c = 0; c < 256; c++) foldTable[c] = (unsigned char)tolower(c);
+    substringKernel = findScalar;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        substringKernel = findAvx2;
+        substringKernelLabel = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        substringKernel = findSse2;
+        substringKernelLabel = "sse2";
+    }
+#endif
+}
+
+const char *substringKernelName() {
+    if (!substringKernel) selectSubstringKernel();
+    return substringKernelLabel;
+}
+
+const char *findCaseInsensitive(const char *haystack, size_t hlen, const char *needle, size_t nlen) {
+    if (nlen == 0) return haystack;
+    if (nlen > hlen) return NULL;
+    if (!substringKernel) selectSubstringKernel();
+    return substringKernel(haystack, hlen, needle, nlen);
+}
+
+char *strcasestr_custom(const char *haystack, const char *needle) {
+    return (char *)findCaseInsensitive(haystack, strlen(haystack), needle, strlen(needle));
+}
+
 void getPassword(char* password, int maxLength) {
     struct termios oldt, newt;
     int i = 0;
@@ -219,573 +1142,6678 @@ void printDate(time_t t) {
     printf("%s", buff);
 }
 
-// --- Student data management ---
-void saveStudents() {
-    FILE *fp = fopen("students.dat", "wb");
-    if (fp) {
-        fwrite(&studentCount, sizeof(int), 1, fp);
-        fwrite(students, sizeof(Student), studentCount, fp);
-        fclose(fp);
-    }
-    // save logs as well
-    fp = fopen("logs.dat", "wb");
-    if (fp) {
-        fwrite(&logCount, sizeof(int), 1, fp);
-        fwrite(logs, sizeof(LogEntry), logCount, fp);
-        fclose(fp);
+// --- Configuration ---
+// Reads "key = value" lines; missing files and keys keep their defaults.
+void loadConfig(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineNo++;
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p || *p == '#') continue;
+        char *eq = strchr(p, '=');
+        if (!eq) {
+            fprintf(stderr, "[!] %s:%d: expected key = value\n", path, lineNo);
+            continue;
+        }
+        char *end = eq;
+        while (end > p && isspace((unsigned char)end[-1])) end--;
+        *end = '\0';
+        char *value = eq + 1;
+        while (isspace((unsigned char)*value)) value++;
+        value[strcspn(value, "\r\n")] = '\0';
+
+        int n = atoi(value);
+        if (strcmp(p, "kdf_iterations") == 0 && n >= 1000) config.kdfIterations = n;
+        else if (strcmp(p, "kdf_threads") == 0 && n >= 1 && n <= 64) config.kdfThreads = n;
+        else if (strcmp(p, "max_loans") == 0 && n >= 1) config.maxLoans = n;
+        else if (strcmp(p, "metrics_interval") == 0 && n >= 0) config.metricsInterval = n;
+        else if (strcmp(p, "pickup_days") == 0 && n >= 1) config.pickupDays = n;
+        else if (strcmp(p, "load_threads") == 0 && n >= 1 && n <= 64) config.loadThreads = n;
+        else fprintf(stderr, "[!] %s:%d: unknown or invalid setting '%s'\n", path, lineNo, p);
     }
+    fclose(fp);
 }
 
-void loadStudents() {
-    FILE *fp = fopen("students.dat", "rb");
-    if (fp) {
-        fread(&studentCount, sizeof(int), 1, fp);
-        fread(students, sizeof(Student), studentCount, fp);
-        fclose(fp);
+// --- Password hashing ---
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} Sha256;
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block(uint32_t state[8], const unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i*4] << 24 | (uint32_t)block[i*4+1] << 16 |
+               (uint32_t)block[i*4+2] << 8 | block[i*4+3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
     }
-    fp = fopen("logs.dat", "rb");
-    if (fp) {
-        fread(&logCount, sizeof(int), 1, fp);
-        fread(logs, sizeof(LogEntry), logCount, fp);
-        fclose(fp);
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+        uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
     }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
 }
 
-int usernameExists(const char* username) {
-    for (int i = 0; i < studentCount; i++) {
-        if (strcmp(students[i].username, username) == 0)
-            return 1;
+static void sha256Init(Sha256 *ctx) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256Update(Sha256 *ctx, const unsigned char *data, size_t len) {
+    ctx->length += len;
+    while (len) {
+        size_t take = 64 - ctx->used;
+        if (take > len) take = len;
+        memcpy(ctx->block + ctx->used, data, take);
+        ctx->used += take;
+        data += take;
+        len -= take;
+        if (ctx->used == 64) {
+            sha256Block(ctx->state, ctx->block);
+            ctx->used = 0;
+        }
     }
-    return 0;
 }
 
-int validateStudentLogin(const char* username, const char* password) {
-    for (int i = 0; i < studentCount; i++) {
-        if (strcmp(students[i].username, username) == 0 &&
-            strcmp(students[i].password, password) == 0)
-            return i; // return student index
+static void sha256Final(Sha256 *ctx, unsigned char out[HASH_LENGTH]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    sha256Update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) sha256Update(ctx, &pad, 1);
+    unsigned char lenBytes[8];
+    for (int i = 0; i < 8; i++) lenBytes[i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256Update(ctx, lenBytes, 8);
+    for (int i = 0; i < 8; i++) {
+        out[i*4] = (unsigned char)(ctx->state[i] >> 24);
+        out[i*4+1] = (unsigned char)(ctx->state[i] >> 16);
+        out[i*4+2] = (unsigned char)(ctx->state[i] >> 8);
+        out[i*4+3] = (unsigned char)ctx->state[i];
     }
-    return -1;
 }
 
-void signup() {
-    char username[50], password[PASSWORD_LENGTH], passwordConfirm[PASSWORD_LENGTH];
-    clearInput();
-    printHeader("Student Signup");
-    printf("Enter username: ");
-    fgets(username, sizeof(username), stdin);
-    username[strcspn(username, "\n")] = 0;
+void sha256(const unsigned char *data, size_t len, unsigned char out[HASH_LENGTH]) {
+    Sha256 ctx;
+    sha256Init(&ctx);
+    sha256Update(&ctx, data, len);
+    sha256Final(&ctx, out);
+}
 
-    if (usernameExists(username)) {
-        printf("\n[!] Username already exists. Try logging in.\n");
-        waitForEnter();
-        return;
+// PBKDF2-HMAC-SHA256 producing a single 32-byte block. The HMAC inner and
+// outer key states are computed once and reused for every iteration.
+void pbkdf2Sha256(const char *password, const unsigned char *salt, size_t saltLength,
+                  uint32_t iterations, unsigned char out[HASH_LENGTH]) {
+    unsigned char key[64] = {0}, pad[64];
+    size_t pwLength = strlen(password);
+    if (pwLength > 64) sha256((const unsigned char *)password, pwLength, key);
+    else memcpy(key, password, pwLength);
+
+    Sha256 inner, outer, ctx;
+    for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+    sha256Init(&inner);
+    sha256Update(&inner, pad, 64);
+    for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+    sha256Init(&outer);
+    sha256Update(&outer, pad, 64);
+
+    unsigned char u[HASH_LENGTH];
+    static const unsigned char blockIndex[4] = { 0, 0, 0, 1 };
+    ctx = inner;
+    sha256Update(&ctx, salt, saltLength);
+    sha256Update(&ctx, blockIndex, 4);
+    sha256Final(&ctx, u);
+    ctx = outer;
+    sha256Update(&ctx, u, HASH_LENGTH);
+    sha256Final(&ctx, u);
+    memcpy(out, u, HASH_LENGTH);
+
+    for (uint32_t it = 1; it < iterations; it++) {
+        ctx = inner;
+        sha256Update(&ctx, u, HASH_LENGTH);
+        sha256Final(&ctx, u);
+        ctx = outer;
+        sha256Update(&ctx, u, HASH_LENGTH);
+        sha256Final(&ctx, u);
+        for (int i = 0; i < HASH_LENGTH; i++) out[i] ^= u[i];
     }
+    memset(key, 0, sizeof(key));
+    memset(pad, 0, sizeof(pad));
+}
+
+static int constantTimeEqual(const unsigned char *a, const unsigned char *b, size_t len) {
+    unsigned char diff = 0;
+    for (size_t i = 0; i < len; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
 
+// KDF work runs on a small pool of worker threads so a slow derivation never
+// holds up the thread that owns the session.
+static pthread_mutex_t kdfLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kdfWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t kdfDone = PTHREAD_COND_INITIALIZER;
+static KdfJob *kdfHead = NULL, *kdfTail = NULL;
+static int kdfWorkers = 0;
+static int kdfNotifyFd = -1;    // eventfd poked after every finished job
+
+static void *kdfWorker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&kdfLock);
     while (1) {
-        printf("Enter password: ");
-        getPassword(password, PASSWORD_LENGTH);
-        if (!isStrongPassword(password)) {
-            printf("[!] Password must be at least 8 characters long and include uppercase, lowercase, digit and special char.\n");
-            continue;
-        }
-        printf("Confirm password: ");
-        getPassword(passwordConfirm, PASSWORD_LENGTH);
-        if (strcmp(password, passwordConfirm) != 0) {
-            printf("[!] Passwords do not match. Try again.\n");
-            continue;
+        while (!kdfHead) pthread_cond_wait(&kdfWork, &kdfLock);
+        KdfJob *job = kdfHead;
+        kdfHead = job->next;
+        if (!kdfHead) kdfTail = NULL;
+        pthread_mutex_unlock(&kdfLock);
+
+        pbkdf2Sha256(job->password, job->salt, SALT_LENGTH, job->iterations, job->out);
+
+        pthread_mutex_lock(&kdfLock);
+        job->done = 1;
+        pthread_cond_broadcast(&kdfDone);
+        if (kdfNotifyFd >= 0) {
+            uint64_t one = 1;
+            if (write(kdfNotifyFd, &one, sizeof(one)) < 0) { /* counter saturated; a wakeup is pending */ }
         }
-        break;
     }
+    return NULL;
+}
 
-    strcpy(students[studentCount].username, username);
-    strcpy(students[studentCount].password, password);
-    students[studentCount].issuedBookCount = 0;
-    studentCount++;
-    saveStudents();
+void kdfStartPool(int threads) {
+    pthread_mutex_lock(&kdfLock);
+    for (; kdfWorkers < threads; kdfWorkers++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, kdfWorker, NULL) != 0) break;
+        pthread_detach(t);
+    }
+    pthread_mutex_unlock(&kdfLock);
+}
 
-    printf("\nSignup successful! You can now login.\n");
-    waitForEnter();
+void kdfSubmit(KdfJob *job) {
+    if (!kdfWorkers) kdfStartPool(config.kdfThreads);
+    job->done = 0;
+    job->next = NULL;
+    pthread_mutex_lock(&kdfLock);
+    if (kdfTail) kdfTail->next = job;
+    else kdfHead = job;
+    kdfTail = job;
+    pthread_cond_signal(&kdfWork);
+    pthread_mutex_unlock(&kdfLock);
 }
 
-int studentLogin() {
-    char username[50], password[PASSWORD_LENGTH];
-    clearInput();
-    printHeader("Student Login");
-    printf("Username: ");
-    fgets(username, sizeof(username), stdin);
-    username[strcspn(username, "\n")] = 0;
+void kdfWait(KdfJob *job) {
+    pthread_mutex_lock(&kdfLock);
+    while (!job->done) pthread_cond_wait(&kdfDone, &kdfLock);
+    pthread_mutex_unlock(&kdfLock);
+}
 
-    printf("Password: ");
-    getPassword(password, PASSWORD_LENGTH);
+// Non-blocking check for callers that learn about completions via kdfSetNotify.
+int kdfJobDone(KdfJob *job) {
+    pthread_mutex_lock(&kdfLock);
+    int done = job->done;
+    pthread_mutex_unlock(&kdfLock);
+    return done;
+}
 
-    int sIndex = validateStudentLogin(username, password);
-    if (sIndex != -1) {
-        printf("\nLogin successful! Welcome, %s\n", username);
-        waitForEnter();
-        return sIndex;
-    } else {
-        printf("\n[!] Invalid credentials.\n");
-        waitForEnter();
-        return -1;
+void kdfSetNotify(int fd) {
+    pthread_mutex_lock(&kdfLock);
+    kdfNotifyFd = fd;
+    pthread_mutex_unlock(&kdfLock);
+}
+
+// --- Task pool ---
+// Startup loading and the background index builds run as tasks on a few
+// worker threads, in the order they were submitted.
+static pthread_mutex_t taskLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t taskWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t taskDone = PTHREAD_COND_INITIALIZER;
+static Task *taskHead = NULL, *taskTail = NULL;
+static int taskWorkers = 0;
+static Task *catalogLoad = NULL;    // the startup task reading books.csv, if any
+
+static void *taskWorker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&taskLock);
+    while (1) {
+        while (!taskHead) pthread_cond_wait(&taskWork, &taskLock);
+        Task *task = taskHead;
+        taskHead = task->next;
+        if (!taskHead) taskTail = NULL;
+        pthread_mutex_unlock(&taskLock);
+
+        task->run();
+
+        pthread_mutex_lock(&taskLock);
+        __atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&taskDone);
     }
+    return NULL;
 }
 
-// --- Library books data ---
-void loadBooks() {
-    lib.streamCount = MAX_STREAMS;
-
-    // BCA
-    strcpy(lib.streams[0].streamName, "BCA");
-    lib.streams[0].subjectCount = 2;
-    strcpy(lib.streams[0].subjects[0].subject, "Data Structures");
-    lib.streams[0].subjects[0].bookCount = 2;
-    strcpy(lib.streams[0].subjects[0].books[0].name, "Data Structures in C");
-    lib.streams[0].subjects[0].books[0].quantity = 5;
-    strcpy(lib.streams[0].subjects[0].books[1].name, "Algorithms Unlocked");
-    lib.streams[0].subjects[0].books[1].quantity = 3;
-    strcpy(lib.streams[0].subjects[1].subject, "Database Management");
-    lib.streams[0].subjects[1].bookCount = 1;
-    strcpy(lib.streams[0].subjects[1].books[0].name, "Database System Concepts");
-    lib.streams[0].subjects[1].books[0].quantity = 4;
-
-    // MCA
-    strcpy(lib.streams[1].streamName, "MCA");
-    lib.streams[1].subjectCount = 2;
-    strcpy(lib.streams[1].subjects[0].subject, "Operating Systems");
-    lib.streams[1].subjects[0].bookCount = 2;
-    strcpy(lib.streams[1].subjects[0].books[0].name, "Operating System Concepts");
-    lib.streams[1].subjects[0].books[0].quantity = 6;
-    strcpy(lib.streams[1].subjects[0].books[1].name, "Modern Operating Systems");
-    lib.streams[1].subjects[0].books[1].quantity = 2;
-    strcpy(lib.streams[1].subjects[1].subject, "Advanced Java");
-    lib.streams[1].subjects[1].bookCount = 1;
-    strcpy(lib.streams[1].subjects[1].books[0].name, "Java: The Complete Reference");
-    lib.streams[1].subjects[1].books[0].quantity = 7;
-
-    // BTech
-    strcpy(lib.streams[2].streamName, "BTech");
-    lib.streams[2].subjectCount = 2;
-    strcpy(lib.streams[2].subjects[0].subject, "Computer Networks");
-    lib.streams[2].subjects[0].bookCount = 2;
-    strcpy(lib.streams[2].subjects[0].books[0].name, "Computer Networking");
-    lib.streams[2].subjects[0].books[0].quantity = 4;
-    strcpy(lib.streams[2].subjects[0].books[1].name, "Data Communication and Networking");
-    lib.streams[2].subjects[0].books[1].quantity = 3;
-    strcpy(lib.streams[2].subjects[1].subject, "Microprocessors");
-    lib.streams[2].subjects[1].bookCount = 1;
-    strcpy(lib.streams[2].subjects[1].books[0].name, "Microprocessor Architecture");
-    lib.streams[2].subjects[1].books[0].quantity = 5;
-
-    // BCom
-    strcpy(lib.streams[3].streamName, "BCom");
-    lib.streams[3].subjectCount = 1;
-    strcpy(lib.streams[3].subjects[0].subject, "Accounting");
-    lib.streams[3].subjects[0].bookCount = 2;
-    strcpy(lib.streams[3].subjects[0].books[0].name, "Financial Accounting");
-    lib.streams[3].subjects[0].books[0].quantity = 8;
-    strcpy(lib.streams[3].subjects[0].books[1].name, "Cost Accounting");
-    lib.streams[3].subjects[0].books[1].quantity = 4;
-
-    // BBA
-    strcpy(lib.streams[4].streamName, "BBA");
-    lib.streams[4].subjectCount = 1;
-    strcpy(lib.streams[4].subjects[0].subject, "Marketing");
-    lib.streams[4].subjects[0].bookCount = 2;
-    strcpy(lib.streams[4].subjects[0].books[0].name, "Principles of Marketing");
-    lib.streams[4].subjects[0].books[0].quantity = 6;
-    strcpy(lib.streams[4].subjects[0].books[1].name, "Consumer Behavior");
-    lib.streams[4].subjects[0].books[1].quantity = 5;
+void taskStartPool(int threads) {
+    pthread_mutex_lock(&taskLock);
+    for (; taskWorkers < threads; taskWorkers++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, taskWorker, NULL) != 0) break;
+        pthread_detach(t);
+    }
+    pthread_mutex_unlock(&taskLock);
 }
 
-void displayBooks() {
-    printHeader("Available Books");
-    printf("| %-12s | %-20s | %-35s | %8s |\n", "Stream", "Subject", "Book Name", "Quantity");
-    printLine(TABLE_WIDTH);
-    for (int i = 0; i < lib.streamCount; i++) {
-        for (int j = 0; j < lib.streams[i].subjectCount; j++) {
-            for (int k = 0; k < lib.streams[i].subjects[j].bookCount; k++) {
-                printf("| %-12s | %-20s | %-35s | %8d |\n",
-                    lib.streams[i].streamName,
-                    lib.streams[i].subjects[j].subject,
-                    lib.streams[i].subjects[j].books[k].name,
-                    lib.streams[i].subjects[j].books[k].quantity);
-            }
-        }
+void taskSubmit(Task *task) {
+    if (!taskWorkers) taskStartPool(config.loadThreads);
+    task->done = 0;
+    task->next = NULL;
+    pthread_mutex_lock(&taskLock);
+    if (taskTail) taskTail->next = task;
+    else taskHead = task;
+    taskTail = task;
+    pthread_cond_signal(&taskWork);
+    pthread_mutex_unlock(&taskLock);
+}
+
+void taskWait(Task *task) {
+    if (__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&taskLock);
+    while (!task->done) pthread_cond_wait(&taskDone, &taskLock);
+    pthread_mutex_unlock(&taskLock);
+}
+
+// Old students.dat and log layouts name books by title or catalog position,
+// so a task decoding them waits until the catalog is in.
+void catalogAwait() {
+    if (catalogLoad) taskWait(catalogLoad);
+}
+
+// Salts come only from the kernel's random source; a predictable salt would
+// defeat them. Returns -1 if none can be read.
+int randomSalt(unsigned char salt[SALT_LENGTH]) {
+    if (getentropy(salt, SALT_LENGTH) == 0) return 0;
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, salt, SALT_LENGTH);
+    close(fd);
+    return n == SALT_LENGTH ? 0 : -1;
+}
+
+// Draws a salt and derives the hash at the configured cost into the caller's
+// buffers, so no lock need be held while the KDF runs. Returns -1 if no salt
+// could be drawn.
+int hashNewPassword(const char *password, unsigned char salt[SALT_LENGTH],
+                    unsigned char hash[HASH_LENGTH], uint32_t *iterations) {
+    if (randomSalt(salt) != 0) return -1;
+    *iterations = (uint32_t)config.kdfIterations;
+    KdfJob job = { .password = password, .salt = salt, .iterations = *iterations };
+    kdfSubmit(&job);
+    kdfWait(&job);
+    memcpy(hash, job.out, HASH_LENGTH);
+    return 0;
+}
+
+int setStudentPassword(int studentIndex, const char *password) {
+    Student *st = &students[studentIndex];
+    return hashNewPassword(password, st->salt, st->passwordHash, &st->kdfIterations);
+}
+
+// Successful verifications are remembered for a few minutes as
+// SHA-256(stored hash || password), so repeat logins cost one hash instead
+// of a full KDF run. The tag changes whenever the stored hash does.
+typedef struct {
+    int student;
+    unsigned char tag[HASH_LENGTH];
+    time_t expiry;
+} VerifyCacheEntry;
+
+static VerifyCacheEntry verifyCache[VERIFY_CACHE_SIZE];
+static pthread_mutex_t verifyCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void verifyCacheTag(const Student *st, const char *password, unsigned char tag[HASH_LENGTH]) {
+    Sha256 ctx;
+    sha256Init(&ctx);
+    sha256Update(&ctx, st->passwordHash, HASH_LENGTH);
+    sha256Update(&ctx, (const unsigned char *)password, strlen(password));
+    sha256Final(&ctx, tag);
+}
+
+int verifyCacheCheck(int studentIndex, const char *password) {
+    unsigned char tag[HASH_LENGTH];
+    verifyCacheTag(&students[studentIndex], password, tag);
+    VerifyCacheEntry *entry = &verifyCache[studentIndex % VERIFY_CACHE_SIZE];
+    pthread_mutex_lock(&verifyCacheLock);
+    int cached = entry->student == studentIndex + 1 && entry->expiry > time(NULL) &&
+                 constantTimeEqual(entry->tag, tag, HASH_LENGTH);
+    pthread_mutex_unlock(&verifyCacheLock);
+    return cached;
+}
+
+void verifyCacheRemember(int studentIndex, const char *password) {
+    unsigned char tag[HASH_LENGTH];
+    verifyCacheTag(&students[studentIndex], password, tag);
+    VerifyCacheEntry *entry = &verifyCache[studentIndex % VERIFY_CACHE_SIZE];
+    pthread_mutex_lock(&verifyCacheLock);
+    entry->student = studentIndex + 1;
+    memcpy(entry->tag, tag, HASH_LENGTH);
+    entry->expiry = time(NULL) + VERIFY_CACHE_SECONDS;
+    pthread_mutex_unlock(&verifyCacheLock);
+}
+
+int verifyStudentPassword(int studentIndex, const char *password) {
+    Student *st = &students[studentIndex];
+    uint64_t start = metricStart();
+    if (verifyCacheCheck(studentIndex, password)) {
+        metricEnd(METRIC_LOGIN, start, 1);
+        return 1;
     }
-    printLine(TABLE_WIDTH);
-    waitForEnter();
+
+    KdfJob job = { .password = password, .salt = st->salt, .iterations = st->kdfIterations };
+    kdfSubmit(&job);
+    kdfWait(&job);
+    int ok = constantTimeEqual(job.out, st->passwordHash, HASH_LENGTH);
+    if (ok) verifyCacheRemember(studentIndex, password);
+    metricEnd(METRIC_LOGIN, start, ok);
+    return ok;
 }
 
-void searchBook() {
-    char keyword[100];
-    clearInput();
-    printHeader("Search Book");
-    printf("Enter book name keyword to search: ");
-    fgets(keyword, sizeof(keyword), stdin);
-    keyword[strcspn(keyword, "\n")] = 0;
+// --- Loan records ---
+// A student's loans live in one array in issue order. A loan keeps its
+// number for life and returned loans stay behind as history; the numbers of
+// the loans still out are kept in a second, short array. Both arrays come
+// from a pool of power-of-two blocks recycled through free lists, so a
+// record costs memory in proportion to its loans.
+#define LOAN_POOL_CLASSES 28
+#define LOAN_POOL_CHUNK (256 * 1024)
+static pthread_mutex_t loanPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static void *loanPoolFree[LOAN_POOL_CLASSES];
+static unsigned char *loanPoolNext;
+static size_t loanPoolLeft;
 
-    int found = 0;
-    printLine(TABLE_WIDTH);
-    printf("| %-12s | %-20s | %-35s | %8s |\n", "Stream", "Subject", "Book Name", "Quantity");
-    printLine(TABLE_WIDTH);
-    for (int i = 0; i < lib.streamCount; i++) {
-        for (int j = 0; j< lib.streams[i].subjectCount; j++) {
-            for (int k = 0; k < lib.streams[i].subjects[j].bookCount; k++) {
-                if (strcasestr_custom(lib.streams[i].subjects[j].books[k].name, keyword)) {
-                    printf("| %-12s | %-20s | %-35s | %8d |\n",
-                    lib.streams[i].streamName,
-                    lib.streams[i].subjects[j].subject,
-                    lib.streams[i].subjects[j].books[k].name,
-                    lib.streams[i].subjects[j].books[k].quantity);
-                    found = 1;
-                }
+static int loanPoolClass(size_t bytes) {
+    int c = 0;
+    while (((size_t)16 << c) < bytes) c++;
+    return c;
+}
+
+static void *loanPoolAlloc(size_t bytes) {
+    int c = loanPoolClass(bytes);
+    size_t size = (size_t)16 << c;
+    void *p;
+    pthread_mutex_lock(&loanPoolLock);
+    if (loanPoolFree[c]) {
+        p = loanPoolFree[c];
+        loanPoolFree[c] = *(void **)p;
+    } else {
+        if (size > loanPoolLeft) {
+            // Hand the rest of the old chunk to the free lists first.
+            while (loanPoolLeft >= 16) {
+                int k = loanPoolClass(loanPoolLeft + 1) - 1;
+                *(void **)loanPoolNext = loanPoolFree[k];
+                loanPoolFree[k] = loanPoolNext;
+                loanPoolNext += (size_t)16 << k;
+                loanPoolLeft -= (size_t)16 << k;
             }
+            size_t chunk = size > LOAN_POOL_CHUNK ? size : LOAN_POOL_CHUNK;
+            loanPoolNext = xrealloc(NULL, chunk);
+            loanPoolLeft = chunk;
         }
+        p = loanPoolNext;
+        loanPoolNext += size;
+        loanPoolLeft -= size;
     }
-    if (!found) {
-        printf("\n[!] No books found matching '%s'\n", keyword);
-    } else {
-        printLine(TABLE_WIDTH);
+    pthread_mutex_unlock(&loanPoolLock);
+    return p;
+}
+
+static void loanPoolRelease(void *p, size_t bytes) {
+    if (!p) return;
+    int c = loanPoolClass(bytes);
+    pthread_mutex_lock(&loanPoolLock);
+    *(void **)p = loanPoolFree[c];
+    loanPoolFree[c] = p;
+    pthread_mutex_unlock(&loanPoolLock);
+}
+
+static void *loanPoolGrow(void *old, size_t oldBytes, size_t newBytes) {
+    void *p = loanPoolAlloc(newBytes);
+    if (old) {
+        memcpy(p, old, oldBytes);
+        loanPoolRelease(old, oldBytes);
     }
-    waitForEnter();
+    return p;
 }
 
-void filterBooksByStreamAndSubject() {
-    printHeader("Filter Books by Stream & Subject");
-    printf("Available Streams:\n");
-    for (int i = 0; i < lib.streamCount; i++) {
-        printf("%d. %s\n", i+1, lib.streams[i].streamName);
+static void studentActivate(Student *st, int slot) {
+    if (st->activeCount == st->activeCap) {
+        int newCap = st->activeCap ? st->activeCap * 2 : 4;
+        st->active = loanPoolGrow(st->active, sizeof(int) * (size_t)st->activeCap, sizeof(int) * (size_t)newCap);
+        st->activeCap = newCap;
     }
-    printf("\nEnter stream number: ");
-    int s;
-    scanf("%d", &s);
-    clearInput();
-    if (s < 1 || s > lib.streamCount) {
-        printf("\n[!] Invalid stream number.\n");
-        waitForEnter();
-        return;
+    st->active[st->activeCount++] = slot;
+}
+
+static void studentDeactivate(Student *st, int slot) {
+    for (int k = 0; k < st->activeCount; k++) {
+        if (st->active[k] == slot) {
+            st->active[k] = st->active[--st->activeCount];
+            return;
+        }
     }
-    s--;
+}
 
-    printf("\nSubjects in %s:\n", lib.streams[s].streamName);
-    for (int j = 0; j < lib.streams[s].subjectCount; j++) {
-        printf("%d. %s\n", j+1, lib.streams[s].subjects[j].subject);
+// Appends a loan to the history, and to the active loans unless it has been
+// returned. Returns its number.
+int studentAddLoan(Student *st, const IssuedBook *loan) {
+    if (st->loanCount == st->loanCap) {
+        int newCap = st->loanCap ? st->loanCap * 2 : 4;
+        st->loans = loanPoolGrow(st->loans, sizeof(IssuedBook) * (size_t)st->loanCap,
+                                 sizeof(IssuedBook) * (size_t)newCap);
+        st->loanCap = newCap;
     }
-    printf("\nEnter subject number: ");
-    int sub;
-    scanf("%d", &sub);
-    clearInput();
-    if (sub < 1 || sub > lib.streams[s].subjectCount) {
-        printf("\n[!] Invalid subject number.\n");
-        waitForEnter();
-        return;
+    int slot = st->loanCount++;
+    st->loans[slot] = *loan;
+    if (!loan->isReturned) studentActivate(st, slot);
+    return slot;
+}
+
+// The earliest outstanding loan of a book, or -1.
+int studentActiveLoan(const Student *st, uint32_t bookId) {
+    int slot = -1;
+    for (int k = 0; k < st->activeCount; k++) {
+        int j = st->active[k];
+        if (st->loans[j].bookId == bookId && (slot < 0 || j < slot)) slot = j;
     }
-    sub--;
+    return slot;
+}
 
-    printHeader("Filtered Books");
-    printf("| %-4s | %-35s | %8s |\n", "No.", "Book Name", "Quantity");
-    printLine(TABLE_WIDTH);
-    for (int k = 0; k < lib.streams[s].subjects[sub].bookCount; k++) {
-        printf("| %-4d | %-35s | %8d |\n", k+1,
-            lib.streams[s].subjects[sub].books[k].name,
-            lib.streams[s].subjects[sub].books[k].quantity);
+void studentAddHold(Student *st, const StudentHold *hold) {
+    if (st->holdCount == st->holdCap) {
+        int newCap = st->holdCap ? st->holdCap * 2 : 4;
+        st->holds = loanPoolGrow(st->holds, sizeof(StudentHold) * (size_t)st->holdCap,
+                                 sizeof(StudentHold) * (size_t)newCap);
+        st->holdCap = newCap;
     }
-    printLine(TABLE_WIDTH);
-    waitForEnter();
+    st->holds[st->holdCount++] = *hold;
 }
 
-// Issue, Return and other functions unchanged (with small UI improvements) ...
+// The student's hold on a book, or NULL. A student holds a book at most once.
+StudentHold *studentHold(const Student *st, uint32_t bookId) {
+    for (int k = 0; k < st->holdCount; k++)
+        if (st->holds[k].bookId == bookId) return &st->holds[k];
+    return NULL;
+}
 
-void addLog(int studentIndex, const char* username, const char* bookName, const char* action) {
-    if (logCount >= MAX_LOGS) return;
-    logs[logCount].studentIndex = studentIndex;
-    strncpy(logs[logCount].username, username, 49);
-    logs[logCount].username[49] = '\0';
-    strncpy(logs[logCount].bookName, bookName, 99);
-    logs[logCount].bookName[99] = '\0';
-    strncpy(logs[logCount].action, action, 9);
-    logs[logCount].action[9] = '\0';
-    logs[logCount].timestamp = time(NULL);
-    logCount++;
+// A copy of the student's holds, for showing them; the caller frees it.
+int studentHoldsCopy(int studentIndex, StudentHold **out) {
+    pthread_rwlock_rdlock(&stateLock);
+    pthread_mutex_lock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    const Student *st = &students[studentIndex];
+    int n = st->holdCount;
+    *out = xrealloc(NULL, sizeof(StudentHold) * (size_t)(n + 1));
+    if (n) memcpy(*out, st->holds, sizeof(StudentHold) * (size_t)n);
+    pthread_mutex_unlock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    pthread_rwlock_unlock(&stateLock);
+    return n;
 }
 
-int calculateFine(time_t dueDate, time_t returnDate) {
-    if (returnDate <= dueDate)
-        return 0;
-    double secondsLate = difftime(returnDate, dueDate);
-    int daysLate = (int)(secondsLate / (60*60*24));
-    if (daysLate == 0) daysLate = 1;
-    return daysLate * FINE_PER_DAY;
+static void studentDropHold(Student *st, StudentHold *hold) {
+    int k = (int)(hold - st->holds);
+    memmove(hold, hold + 1, sizeof(StudentHold) * (size_t)(st->holdCount - k - 1));
+    st->holdCount--;
 }
 
-void issueBook(int loggedInStudentIndex) {
-    Student *student = &students[loggedInStudentIndex];
-    printHeader("Issue Book");
+// --- Data files ---
+// students.dat and logs.dat share one explicitly laid out, little-endian format:
+//   0  u32 magic            16 u64 record count
+//   4  u16 version          24 u64 last journal sequence folded in
+//   6  u16 header size      32 reserved (zero) up to DATA_HEADER_SIZE
+//   8  u32 record size
+//  12  u32 CRC-32 of the header with this field zeroed
+// Log segments use bytes 32-55 for the segment number and its time range.
+// The header is followed by fixed-size records, each ending in a CRC-32 of its other bytes.
+// A record size of 0 means variable-length records, each a u32 total length,
+// the payload and the CRC-32.
+// Files are mapped read-only and records are checked when they are decoded,
+// so opening a file only touches its header page.
+static void storeLe16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
 
-    if(student->issuedBookCount >= MAX_ISSUED_BOOKS_PER_STUDENT) {
-        printf("[!] You have reached the maximum limit of issued books.\n");
-        waitForEnter();
-        return;
-    }
+static void storeLe32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
 
-    filterBooksByStreamAndSubject();
+static void storeLe64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
 
-    printf("Enter stream number to issue book from: ");
-    int s; scanf("%d", &s);
-    clearInput();
-    if (s < 1 || s > lib.streamCount) {
-        printf("\n[!] Invalid stream number.\n");
-        waitForEnter();
-        return;
-    }
-    s--;
+static uint32_t loadLe32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
 
-    printf("Enter subject number: ");
-    int sub; scanf("%d", &sub);
-    clearInput();
-    if (sub < 1 || sub > lib.streams[s].subjectCount) {
-        printf("\n[!] Invalid subject number.\n");
-        waitForEnter();
-        return;
+static uint64_t loadLe64(const unsigned char *p) {
+    return (uint64_t)loadLe32(p) | (uint64_t)loadLe32(p + 4) << 32;
+}
+
+static void storeText(unsigned char *p, const char *text, size_t width) {
+    size_t n = 0;
+    while (n < width - 1 && text[n]) n++;
+    memcpy(p, text, n);
+    memset(p + n, 0, width - n);
+}
+
+static void loadText(char *dst, size_t dstSize, const unsigned char *p, size_t width) {
+    size_t n = width < dstSize ? width : dstSize;
+    memcpy(dst, p, n);
+    dst[n - 1] = '\0';
+}
+
+// Maps path and validates its header. Returns 0 on success, 1 if the file is
+// missing or not in this format (so older layouts can be tried), and -1 if
+// it is in this format but damaged.
+static int mapDataFile(const char *path, uint32_t magic, uint16_t expectedVersion,
+                       uint32_t recordSize, MappedFile *out) {
+    memset(out, 0, sizeof(*out));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < DATA_HEADER_SIZE) {
+        close(fd);
+        return 1;
+    }
+    unsigned char *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    if (loadLe32(base) != magic) {
+        munmap(base, (size_t)st.st_size);
+        return 1;
     }
-    sub--;
 
-    printf("Enter book number: ");
-    int b; scanf("%d", &b);
-    clearInput();
-    if (b < 1 || b > lib.streams[s].subjects[sub].bookCount) {
-        printf("\n[!] Invalid book number.\n");
-        waitForEnter();
-        return;
+    unsigned char header[DATA_HEADER_SIZE];
+    memcpy(header, base, DATA_HEADER_SIZE);
+    storeLe32(header + 12, 0);
+    uint16_t version = (uint16_t)(base[4] | base[5] << 8);
+    uint16_t headerSize = (uint16_t)(base[6] | base[7] << 8);
+    uint64_t count = loadLe64(base + 16);
+    const char *problem = NULL;
+    if (crc32(header, DATA_HEADER_SIZE) != loadLe32(base + 12)) problem = "header checksum mismatch";
+    else if (version != expectedVersion) problem = "unsupported version";
+    else if (headerSize < DATA_HEADER_SIZE || headerSize > st.st_size) problem = "bad header size";
+    else if (loadLe32(base + 8) != recordSize) problem = "unexpected record size";
+    else if (count > ((uint64_t)st.st_size - headerSize) / (recordSize ? recordSize : 8))
+        problem = "record count larger than the file";
+    if (problem) {
+        fprintf(stderr, "[!] %s: %s\n", path, problem);
+        munmap(base, (size_t)st.st_size);
+        return -1;
     }
-    b--;
 
-    if (lib.streams[s].subjects[sub].books[b].quantity > 0) {
-        lib.streams[s].subjects[sub].books[b].quantity--;
+    out->base = base;
+    out->size = (size_t)st.st_size;
+    out->records = base + headerSize;
+    out->count = count;
+    out->recordSize = recordSize;
+    out->seq = loadLe64(base + 24);
+    for (int i = 0; i < 3; i++) out->extra[i] = loadLe64(base + 32 + 8 * i);
+    return 0;
+}
+
+// Returns the format version of a data file with the given magic, or -1.
+static int dataFileVersion(const char *path, uint32_t magic) {
+    unsigned char header[8];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    int ok = fread(header, sizeof(header), 1, fp) == 1 && loadLe32(header) == magic;
+    fclose(fp);
+    return ok ? header[4] | header[5] << 8 : -1;
+}
 
-        IssuedBook *ib = &student->issuedBooks[student->issuedBookCount];
-        ib->streamIndex = s;
-        ib->subjectIndex = sub;
-        ib->bookIndex = b;
-        strcpy(ib->bookName, lib.streams[s].subjects[sub].books[b].name);
-        ib->issueDate = time(NULL);
-        ib->dueDate = ib->issueDate + BORROW_DAYS * 24 * 60 * 60;
-        ib->returnDate = 0;
-        ib->isReturned = 0;
-        student->issuedBookCount++;
+static void unmapDataFile(MappedFile *mf) {
+    if (mf->base) munmap(mf->base, mf->size);
+    memset(mf, 0, sizeof(*mf));
+}
 
-        addLog(loggedInStudentIndex, student->username, ib->bookName, "Issued");
+static const unsigned char *mappedRecord(const MappedFile *mf, uint64_t i) {
+    const unsigned char *rec = mf->records + i * mf->recordSize;
+    if (crc32(rec, mf->recordSize - 4) != loadLe32(rec + mf->recordSize - 4)) return NULL;
+    return rec;
+}
 
-        printf("\n[+] Book '%s' issued successfully!\n", ib->bookName);
-        printf("Due date: ");
-        printDate(ib->dueDate);
-        printf("\n");
-    } else {
-        printf("\n[!] Sorry, book not available currently.\n");
-    }
-    waitForEnter();
+// Variable-length records are read in order: returns the payload of the
+// record at *offset and advances past it, or NULL if it is damaged.
+static const unsigned char *mappedNextRecord(const MappedFile *mf, size_t *offset, uint32_t *payloadSize) {
+    size_t avail = mf->size - (size_t)(mf->records - mf->base) - *offset;
+    const unsigned char *rec = mf->records + *offset;
+    if (avail < 8) return NULL;
+    uint32_t len = loadLe32(rec);
+    if (len < 8 || len > avail || crc32(rec, len - 4) != loadLe32(rec + len - 4)) return NULL;
+    *offset += len;
+    *payloadSize = len - 8;
+    return rec + 4;
 }
 
-void returnBook(int loggedInStudentIndex) {
-    Student *student = &students[loggedInStudentIndex];
-    printHeader("Return Book");
+typedef void (*RecordEncoder)(const void *ctx, int index, unsigned char *out);
+typedef uint32_t (*RecordSizer)(const void *ctx, int index);    // payload bytes
 
-    if (student->issuedBookCount == 0) {
-        printf("[!] You have no issued books to return.\n");
-        waitForEnter();
-        return;
-    }
+// Writes a data file through a temporary file and renames it into place, so
+// a crash leaves either the old or the new file. With a recordSize of 0,
+// sizer gives each record's payload size. Bytes written count as ioKind.
+static int writeDataFile(const char *path, int ioKind, uint32_t magic, uint16_t version, uint32_t recordSize,
+                         int count, uint64_t seq, const uint64_t *extra,
+                         RecordSizer sizer, RecordEncoder encode, const void *ctx) {
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return -1;
 
-    printf("| %-4s | %-35s | %-12s |\n", "No.", "Book Name", "Due Date");
-    printLine(TABLE_WIDTH);
-    int hasIssued = 0;
-    for (int i = 0; i < student->issuedBookCount; i++) {
-        IssuedBook *ib = &student->issuedBooks[i];
-        if (ib->isReturned == 0) {
-            printf("| %-4d | %-35s | ", i+1, ib->bookName);
-            printDate(ib->dueDate);
-            printf(" |\n");
-            hasIssued = 1;
+    unsigned char header[DATA_HEADER_SIZE] = {0};
+    storeLe32(header, magic);
+    storeLe16(header + 4, version);
+    storeLe16(header + 6, DATA_HEADER_SIZE);
+    storeLe32(header + 8, recordSize);
+    storeLe64(header + 16, (uint64_t)count);
+    storeLe64(header + 24, seq);
+    for (int i = 0; extra && i < 3; i++) storeLe64(header + 32 + 8 * i, extra[i]);
+    storeLe32(header + 12, crc32(header, DATA_HEADER_SIZE));
+    int ok = fwrite(header, DATA_HEADER_SIZE, 1, fp) == 1;
+    uint64_t written = DATA_HEADER_SIZE;
+
+    unsigned char *rec = NULL;
+    size_t recCap = 0;
+    for (int i = 0; ok && i < count; i++) {
+        uint32_t size = recordSize ? recordSize : 4 + sizer(ctx, i) + 4;
+        if (size > recCap) {
+            recCap = size;
+            rec = xrealloc(rec, recCap);
         }
+        memset(rec, 0, size);
+        if (recordSize) {
+            encode(ctx, i, rec);
+        } else {
+            storeLe32(rec, size);
+            encode(ctx, i, rec + 4);
+        }
+        storeLe32(rec + size - 4, crc32(rec, size - 4));
+        ok = fwrite(rec, size, 1, fp) == 1;
+        written += size;
     }
-    printLine(TABLE_WIDTH);
-    if (!hasIssued) {
-        printf("All books have been returned.\n");
-        waitForEnter();
-        return;
+    free(rec);
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    metricIo(ioKind, 0, written);
+    return 0;
+}
+
+static uint32_t studentRecordSize(const void *ctx, int index) {
+    const Student *st = (const Student *)ctx + index;
+    return DISK_STUDENT_HEAD + (uint32_t)st->loanCount * DISK_LOAN_SIZE + 4 + (uint32_t)st->holdCount * DISK_HOLD_SIZE;
+}
+
+static void encodeStudent(const void *ctx, int index, unsigned char *p) {
+    const Student *st = (const Student *)ctx + index;
+    storeText(p, st->username, DISK_NAME_LENGTH);
+    p += DISK_NAME_LENGTH;
+    memcpy(p, st->salt, SALT_LENGTH);
+    p += SALT_LENGTH;
+    memcpy(p, st->passwordHash, HASH_LENGTH);
+    p += HASH_LENGTH;
+    storeLe32(p, st->kdfIterations);
+    storeLe32(p + 4, (uint32_t)st->loanCount);
+    p += 8;
+    for (int j = 0; j < st->loanCount; j++, p += DISK_LOAN_SIZE) {
+        const IssuedBook *ib = &st->loans[j];
+        storeLe32(p, ib->bookId);
+        storeLe32(p + 4, (uint32_t)ib->isReturned);
+        storeLe64(p + 8, (uint64_t)ib->issueDate);
+        storeLe64(p + 16, (uint64_t)ib->dueDate);
+        storeLe64(p + 24, (uint64_t)ib->returnDate);
+    }
+    storeLe32(p, (uint32_t)st->holdCount);
+    p += 4;
+    for (int j = 0; j < st->holdCount; j++, p += DISK_HOLD_SIZE) {
+        const StudentHold *h = &st->holds[j];
+        storeLe32(p, h->bookId);
+        storeLe32(p + 4, (uint32_t)h->ready);
+        storeLe64(p + 8, h->ticket);
+        storeLe64(p + 16, (uint64_t)h->time);
     }
+}
 
-    printf("Enter the number of the book to return: ");
-    int choice;
-    scanf("%d", &choice);
-    clearInput();
-    if (choice < 1 || choice > student->issuedBookCount || student->issuedBooks[choice -1].isReturned) {
-        printf("[!] Invalid choice.\n");
-        waitForEnter();
-        return;
+// Loans from before stable book ids are matched by catalog position, then by
+// title. Returns 0 if the book is gone.
+static uint32_t legacyBookId(int s, int sub, int b, const char *title) {
+    catalogAwait();
+    int id = catalogBookAt(s, sub, b);
+    if (id < 0 || strcmp(bookName(id), title) != 0) id = catalogFindBook(title);
+    return id >= 0 ? lib.bookId[id] : 0;
+}
+
+// Versions 1 and 2 have room for LEGACY_LOANS_PER_STUDENT loans; later
+// records are exactly 'size' bytes, and version 4 adds the holds.
+static int decodeStudent(const unsigned char *p, uint32_t size, Student *st, int version) {
+    memset(st, 0, sizeof(*st));
+    if (size < DISK_STUDENT_HEAD) return -1;
+    loadText(st->username, sizeof(st->username), p, DISK_NAME_LENGTH);
+    p += DISK_NAME_LENGTH;
+    memcpy(st->salt, p, SALT_LENGTH);
+    p += SALT_LENGTH;
+    memcpy(st->passwordHash, p, HASH_LENGTH);
+    p += HASH_LENGTH;
+    st->kdfIterations = loadLe32(p);
+    uint32_t loans = loadLe32(p + 4);
+    p += 8;
+    uint32_t room = version >= 3 ? (size - DISK_STUDENT_HEAD) / DISK_LOAN_SIZE : LEGACY_LOANS_PER_STUDENT;
+    if (loans > room || !st->username[0]) return -1;
+    // The hold list follows the loans; it is checked before anything is
+    // allocated, so a damaged record leaves nothing behind.
+    uint32_t holds = 0;
+    if (version >= 4) {
+        uint32_t left = size - DISK_STUDENT_HEAD - loans * DISK_LOAN_SIZE;
+        if (left < 4) return -1;
+        holds = loadLe32(p + loans * DISK_LOAN_SIZE);
+        if (holds > (left - 4) / DISK_HOLD_SIZE) return -1;
     }
+    for (uint32_t j = 0; j < loans; j++) {
+        IssuedBook ib = {0};
+        if (version >= 2) {
+            ib.bookId = loadLe32(p);
+            ib.isReturned = (int)loadLe32(p + 4);
+            p += 8;
+        } else {
+            char title[DISK_TITLE_LENGTH + 1];
+            loadText(title, sizeof(title), p + 40, DISK_TITLE_LENGTH);
+            ib.bookId = legacyBookId((int)loadLe32(p), (int)loadLe32(p + 4), (int)loadLe32(p + 8), title);
+            ib.isReturned = (int)loadLe32(p + 12);
+            p += 16;
+        }
+        ib.issueDate = (time_t)loadLe64(p);
+        ib.dueDate = (time_t)loadLe64(p + 8);
+        ib.returnDate = (time_t)loadLe64(p + 16);
+        p += 24 + (version >= 2 ? 0 : DISK_TITLE_LENGTH);
+        studentAddLoan(st, &ib);
+    }
+    if (version >= 4) {
+        p += 4;
+        for (uint32_t j = 0; j < holds; j++, p += DISK_HOLD_SIZE) {
+            StudentHold h = { loadLe32(p), (int)loadLe32(p + 4), loadLe64(p + 8), (time_t)loadLe64(p + 16) };
+            studentAddHold(st, &h);
+        }
+    }
+    return 0;
+}
 
-    IssuedBook *ib = &student->issuedBooks[choice - 1];
-    int s = ib->streamIndex;
-    int sub = ib->subjectIndex;
-    int b = ib->bookIndex;
+#define LOG_USER_AT 4
+#define LOG_BOOK_AT (LOG_USER_AT + DISK_NAME_LENGTH)
+#define LOG_ACTION_AT (LOG_BOOK_AT + 4)
+#define LOG_TIME_AT (LOG_ACTION_AT + DISK_ACTION_LENGTH)
+#define LOG_SEQ_AT (LOG_TIME_AT + 8)
 
-    lib.streams[s].subjects[sub].books[b].quantity++;
-    ib->isReturned = 1;
-    ib->returnDate = time(NULL);
+static void encodeLog(const void *ctx, int index, unsigned char *p) {
+    const LogEntry *e = (const LogEntry *)ctx + index;
+    storeLe32(p, (uint32_t)e->studentIndex);
+    storeText(p + LOG_USER_AT, e->username, DISK_NAME_LENGTH);
+    storeLe32(p + LOG_BOOK_AT, e->bookId);
+    storeText(p + LOG_ACTION_AT, e->action, DISK_ACTION_LENGTH);
+    storeLe64(p + LOG_TIME_AT, (uint64_t)e->timestamp);
+    storeLe64(p + LOG_SEQ_AT, e->seq);
+}
 
-    int fine = calculateFine(ib->dueDate, ib->returnDate);
-    if (fine > 0) {
-        printf("\n[!] Book '%s' returned. You have a fine of %d units for late return.\n", ib->bookName, fine);
+// Versions 1 and 2 stored the title in place of the book id; it is looked up
+// in the catalog.
+static void decodeLog(const unsigned char *p, LogEntry *e, int version) {
+    e->studentIndex = (int)loadLe32(p);
+    loadText(e->username, sizeof(e->username), p + LOG_USER_AT, DISK_NAME_LENGTH);
+    int shift = 0;
+    if (version >= 3) {
+        e->bookId = loadLe32(p + LOG_BOOK_AT);
     } else {
-        printf("\n[+] Book '%s' returned successfully, no fine.\n", ib->bookName);
+        char title[DISK_TITLE_LENGTH + 1];
+        loadText(title, sizeof(title), p + LOG_BOOK_AT, DISK_TITLE_LENGTH);
+        catalogAwait();
+        int id = catalogFindBook(title);
+        e->bookId = id >= 0 ? lib.bookId[id] : 0;
+        shift = DISK_TITLE_LENGTH - 4;
     }
+    loadText(e->action, sizeof(e->action), p + shift + LOG_ACTION_AT, DISK_ACTION_LENGTH);
+    e->timestamp = (time_t)loadLe64(p + shift + LOG_TIME_AT);
+    e->seq = version >= 2 ? loadLe64(p + shift + LOG_SEQ_AT) : 0;
+}
 
-    addLog(loggedInStudentIndex, student->username, ib->bookName, "Returned");
+// --- Log report index ---
+static void timelineInsert(Timeline *t, time_t timestamp, int logIndex) {
+    if (t->count == t->cap) {
+        int newCap = t->cap ? t->cap * 2 : 8;
+        t->entries = arenaGrow(&logIndexArena, t->entries, sizeof(TimelineEntry) * (size_t)t->cap,
+                               sizeof(TimelineEntry) * (size_t)newCap);
+        t->cap = newCap;
+    }
+    // Entries arrive in time order unless the clock was set back.
+    int pos = t->count;
+    while (pos > 0 && t->entries[pos - 1].timestamp > timestamp) pos--;
+    memmove(&t->entries[pos + 1], &t->entries[pos], sizeof(TimelineEntry) * (size_t)(t->count - pos));
+    t->entries[pos].timestamp = timestamp;
+    t->entries[pos].logIndex = logIndex;
+    t->count++;
+}
 
-    waitForEnter();
+// Position of the first entry at or after 'timestamp'.
+static int timelineLowerBound(const Timeline *t, time_t timestamp) {
+    int lo = 0, hi = t->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (t->entries[mid].timestamp < timestamp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
 }
 
-void showIssuedBooksByStudent(int studentIndex) {
-    Student *student = &students[studentIndex];
-    printHeader("My Issued Books");
-    if (student->issuedBookCount == 0) {
-        printf("You have no issued books.\n");
-    } else {
-        printf("| %-4s | %-35s | %-12s | %-12s | %-10s |\n", "No.", "Book Name", "Issued On", "Due Date", "Status");
-        printLine(TABLE_WIDTH);
-        for (int i = 0; i < student->issuedBookCount; i++) {
-            IssuedBook *ib = &student->issuedBooks[i];
-            printf("| %-4d | %-35s | ", i+1, ib->bookName);
-            printDate(ib->issueDate);
-            printf(" | ");
-            printDate(ib->dueDate);
-            printf(" | %-10s |\n", ib->isReturned ? "Returned" : "Issued");
-        }
-        printLine(TABLE_WIDTH);
+static void logKey(char *key, size_t size, char kind, const char *name) {
+    size_t n = 0;
+    key[n++] = kind;
+    key[n++] = ':';
+    while (*name && n < size - 1) key[n++] = (char)tolower((unsigned char)*name++);
+    key[n] = '\0';
+}
+
+static void logIndexGrowSlots() {
+    int newCap = logIdx.slotCap ? logIdx.slotCap * 2 : 256;
+    int *slots = calloc((size_t)newCap, sizeof(int));
+    if (!slots) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
     }
-    waitForEnter();
+    for (int k = 0; k < logIdx.keyCount; k++) {
+        int j = (int)(hashString(poolStr(&logIdx.keys, logIdx.keyOffs[k])) & (uint32_t)(newCap - 1));
+        while (slots[j]) j = (j + 1) & (newCap - 1);
+        slots[j] = k + 1;
+    }
+    free(logIdx.slots);
+    logIdx.slots = slots;
+    logIdx.slotCap = newCap;
 }
 
-void adminReportMenu() {
-    while (1) {
-        printHeader("Admin Report: Issued/Returned Books");
-        if (logCount == 0) {
-            printf("No records found.\n");
-        } else {
-            printf("| %-4s | %-15s | %-35s | %-10s | %-19s |\n", "No.", "User", "Book Name", "Action", "Date/Time");
-            printLine(TABLE_WIDTH);
-            for (int i = 0; i < logCount; i++) {
-                char timebuff[20];
-                struct tm *tm_info = localtime(&logs[i].timestamp);
-                strftime(timebuff, 20, "%Y-%m-%d %H:%M:%S", tm_info);
-                printf("| %-4d | %-15s | %-35s | %-10s | %-19s |\n",
-                    i+1, logs[i].username, logs[i].bookName, logs[i].action, timebuff);
-            }
-            printLine(TABLE_WIDTH);
+// Returns the timeline for a user ('u') or book ('b'), or NULL if there is
+// none and 'create' is 0.
+static Timeline *logIndexTimeline(char kind, const char *name, int create) {
+    char key[CATALOG_FIELD_LENGTH + 2];
+    logKey(key, sizeof(key), kind, name);
+    if (logIdx.slotCap) {
+        int j = (int)(hashString(key) & (uint32_t)(logIdx.slotCap - 1));
+        while (logIdx.slots[j]) {
+            int k = logIdx.slots[j] - 1;
+            if (strcmp(poolStr(&logIdx.keys, logIdx.keyOffs[k]), key) == 0)
+                return &logIdx.byKey[k];
+            j = (j + 1) & (logIdx.slotCap - 1);
         }
-        printf("Press Enter to return to Admin menu...");
-        clearInput();
-        getchar();
-        return;
     }
+    if (!create) return NULL;
+
+    if ((logIdx.keyCount + 1) * 4 > logIdx.slotCap * 3) logIndexGrowSlots();
+    if (logIdx.keyCount == logIdx.keyCap) {
+        logIdx.keyCap = logIdx.keyCap ? logIdx.keyCap * 2 : 64;
+        logIdx.keyOffs = xrealloc(logIdx.keyOffs, sizeof(uint32_t) * (size_t)logIdx.keyCap);
+        logIdx.byKey = xrealloc(logIdx.byKey, sizeof(Timeline) * (size_t)logIdx.keyCap);
+    }
+    int k = logIdx.keyCount++;
+    logIdx.keyOffs[k] = poolIntern(&logIdx.keys, key);
+    memset(&logIdx.byKey[k], 0, sizeof(Timeline));
+    int j = (int)(hashString(key) & (uint32_t)(logIdx.slotCap - 1));
+    while (logIdx.slots[j]) j = (j + 1) & (logIdx.slotCap - 1);
+    logIdx.slots[j] = k + 1;
+    return &logIdx.byKey[k];
 }
 
-void adminMenu() {
-    while (1) {
-        printHeader("Admin Menu");
-        printf("1. View All Books\n");
-        printf("2. Search Book\n");
+static void logIndexAdd(int logIndex, const LogEntry *e) {
+    char bookKey[16];
+    snprintf(bookKey, sizeof(bookKey), "%u", e->bookId);
+    timelineInsert(&logIdx.all, e->timestamp, logIndex);
+    timelineInsert(logIndexTimeline('u', e->username, 1), e->timestamp, logIndex);
+    timelineInsert(logIndexTimeline('b', bookKey, 1), e->timestamp, logIndex);
+}
+
+// The timeline for a username or, failing that, an exact book title.
+static const Timeline *logIndexFilter(const char *filter) {
+    const Timeline *t = logIndexTimeline('u', filter, 0);
+    int id = catalogFindBook(filter);
+    if (!t && id >= 0) {
+        char bookKey[16];
+        snprintf(bookKey, sizeof(bookKey), "%u", lib.bookId[id]);
+        t = logIndexTimeline('b', bookKey, 0);
+    }
+    return t;
+}
+
+// Built on the first report; addLog keeps it current afterwards. Callers
+// hold historyLock.
+void buildLogIndex() {
+    if (logIdx.built) return;
+    for (int i = 0; i < logCount; i++) {
+        LogEntry e;
+        if (readLog(i, &e) == 0) logIndexAdd(i, &e);
+    }
+    logIdx.built = 1;
+}
+
+// --- Log store ---
+static LogSegment logBuffers[2];
+static LogSegment *activeSegment = &logBuffers[0];
+static LogSegment *sealedSegment = NULL;    // sealed but not yet on disk
+static SegmentInfo *segments = NULL;
+static int segmentCount = 0, segmentCap = 0;
+static pthread_mutex_t logStoreLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logSealed = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t logWritten = PTHREAD_COND_INITIALIZER;
+static int logWriterRunning = 0;
+static int legacyLogsImported = 0;
+static MappedFile segmentMap;               // the segment readers last used
+static int segmentMapNumber = -1;
+
+static void segmentPath(char *buf, size_t size, int number) {
+    snprintf(buf, size, LOG_DIR "/segment-%06d.dat", number);
+}
+
+static int writeSegment(const LogSegment *seg, const char *path, uint64_t seq) {
+    uint64_t extra[3] = { (uint64_t)seg->number, 0, 0 };
+    if (seg->count) {
+        extra[1] = (uint64_t)seg->entries[0].timestamp;
+        extra[2] = (uint64_t)seg->entries[seg->count - 1].timestamp;
+    }
+    return writeDataFile(path, IO_LOGS, LOG_FILE_MAGIC, LOG_FORMAT_VERSION, DISK_LOG_SIZE,
+                         seg->count, seq, extra, NULL, encodeLog, seg->entries);
+}
+
+static void *logWriter(void *arg) {
+    (void)arg;
+    char path[64];
+    pthread_mutex_lock(&logStoreLock);
+    while (1) {
+        while (!sealedSegment) pthread_cond_wait(&logSealed, &logStoreLock);
+        LogSegment *seg = sealedSegment;
+        pthread_mutex_unlock(&logStoreLock);
+
+        segmentPath(path, sizeof(path), seg->number);
+        int ok = writeSegment(seg, path, seg->entries[seg->count - 1].seq) == 0;
+        if (!ok) {
+            perror(path);
+            sleep(1);   // keep the segment in memory and retry
+        }
+
+        pthread_mutex_lock(&logStoreLock);
+        if (ok) {
+            sealedSegment = NULL;
+            pthread_cond_broadcast(&logWritten);
+        }
+    }
+    return NULL;
+}
+
+// Hands the full active segment to the writer and switches to the other
+// buffer. Waits only if the writer is still busy with the previous segment.
+static void sealActiveSegment() {
+    pthread_mutex_lock(&logStoreLock);
+    while (sealedSegment) pthread_cond_wait(&logWritten, &logStoreLock);
+
+    LogSegment *seg = activeSegment;
+    if (segmentCount == segmentCap) {
+        segmentCap = segmentCap ? segmentCap * 2 : 64;
+        segments = xrealloc(segments, sizeof(SegmentInfo) * (size_t)segmentCap);
+    }
+    SegmentInfo *info = &segments[segmentCount++];
+    info->number = seg->number;
+    info->firstIndex = logCount - seg->count;
+    info->count = seg->count;
+    info->minTime = seg->entries[0].timestamp;
+    info->maxTime = seg->entries[seg->count - 1].timestamp;
+    info->lastSeq = seg->entries[seg->count - 1].seq;
+
+    sealedSegment = seg;
+    activeSegment = seg == &logBuffers[0] ? &logBuffers[1] : &logBuffers[0];
+    activeSegment->count = 0;
+    activeSegment->number = seg->number + 1;
+    if (!logWriterRunning) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, logWriter, NULL) == 0) {
+            pthread_detach(t);
+            logWriterRunning = 1;
+        }
+    }
+    pthread_cond_signal(&logSealed);
+    pthread_mutex_unlock(&logStoreLock);
+}
+
+// Waits until every sealed segment is on disk.
+static void syncLogStore() {
+    pthread_mutex_lock(&logStoreLock);
+    while (sealedSegment) pthread_cond_wait(&logWritten, &logStoreLock);
+    pthread_mutex_unlock(&logStoreLock);
+}
+
+// Appends one entry. Callers hold historyLock, except during startup.
+void addLog(int studentIndex, const char* username, uint32_t bookId, const char* action,
+            time_t timestamp, uint64_t seq) {
+    if (activeSegment->count == LOG_SEGMENT_ENTRIES) sealActiveSegment();
+    LogEntry *e = &activeSegment->entries[activeSegment->count];
+    e->studentIndex = studentIndex;
+    strncpy(e->username, username, 49);
+    e->username[49] = '\0';
+    e->bookId = bookId;
+    strncpy(e->action, action, 9);
+    e->action[9] = '\0';
+    e->timestamp = timestamp;
+    e->seq = seq;
+    activeSegment->count++;
+    if (logIdx.built) logIndexAdd(logCount, e);
+    logCount++;
+}
+
+// Copies log entry i into *out, mapping at most one older segment at a time.
+// Callers hold historyLock so addLog cannot seal segments under it. Returns
+// -1 if its on-disk record is damaged or missing.
+int readLog(int i, LogEntry *out) {
+    int activeFirst = logCount - activeSegment->count;
+    if (i >= activeFirst) {
+        *out = activeSegment->entries[i - activeFirst];
+        return 0;
+    }
+    int lo = 0, hi = segmentCount - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (segments[mid].firstIndex <= i) lo = mid;
+        else hi = mid - 1;
+    }
+    const SegmentInfo *info = &segments[lo];
+    int offset = i - info->firstIndex;
+    int rc = 0;
+
+    pthread_mutex_lock(&logStoreLock);
+    if (sealedSegment && sealedSegment->number == info->number) {
+        *out = sealedSegment->entries[offset];
+    } else {
+        if (segmentMapNumber != info->number) {
+            char path[64];
+            unmapDataFile(&segmentMap);
+            segmentMapNumber = -1;
+            segmentPath(path, sizeof(path), info->number);
+            if (mapDataFile(path, LOG_FILE_MAGIC, LOG_FORMAT_VERSION, DISK_LOG_SIZE, &segmentMap) == 0)
+                segmentMapNumber = info->number;
+        }
+        const unsigned char *rec = NULL;
+        if (segmentMapNumber == info->number && (uint64_t)offset < segmentMap.count)
+            rec = mappedRecord(&segmentMap, (uint64_t)offset);
+        if (rec) {
+            decodeLog(rec, out, LOG_FORMAT_VERSION);
+            metricIo(IO_LOGS, DISK_LOG_SIZE, 0);
+        } else {
+            memset(out, 0, sizeof(*out));
+            strcpy(out->action, "Damaged");
+            rc = -1;
+        }
+    }
+    pthread_mutex_unlock(&logStoreLock);
+    return rc;
+}
+
+// Persists the active segment as logs/active.dat. Callers hold the write
+// side of stateLock.
+static int writeActiveSegment(uint64_t seq) {
+    syncLogStore();
+    if (writeSegment(activeSegment, LOG_DIR "/active.dat", seq) != 0) return -1;
+    if (legacyLogsImported) {
+        rename("logs.dat", "logs.dat.imported");
+        legacyLogsImported = 0;
+    }
+    return 0;
+}
+
+static int compareSegmentNumbers(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Reads the raw-struct logs.dat layouts written by earlier versions.
+static void loadLegacyLogs(FILE *fp) {
+    int count = 0, magic = 0;
+    int ok = fread(&magic, sizeof(int), 1, fp) == 1;
+    if (ok && magic == LOGS_MAGIC_V2) {
+        ok = fread(&count, sizeof(int), 1, fp) == 1 &&
+             fread(&logsSeq, sizeof(uint64_t), 1, fp) == 1;
+    } else {
+        count = magic;
+    }
+    struct {
+        int studentIndex;
+        char username[50];
+        char bookName[100];
+        char action[10];
+        time_t timestamp;
+    } old;
+    for (int i = 0; ok && i < count && fread(&old, sizeof(old), 1, fp) == 1; i++) {
+        old.username[sizeof(old.username) - 1] = '\0';
+        old.bookName[sizeof(old.bookName) - 1] = '\0';
+        old.action[sizeof(old.action) - 1] = '\0';
+        catalogAwait();
+        int id = catalogFindBook(old.bookName);
+        addLog(old.studentIndex, old.username, id >= 0 ? lib.bookId[id] : 0, old.action, old.timestamp, 0);
+    }
+}
+
+// Imports logs.dat from before the log was segmented; it is renamed once the
+// imported entries have been written to logs/.
+static void importLegacyLogs() {
+    MappedFile mf;
+    int rc = mapDataFile("logs.dat", LOG_FILE_MAGIC, 1, DISK_LOG_SIZE_V1, &mf);
+    if (rc == 0) {
+        for (uint64_t i = 0; i < mf.count; i++) {
+            const unsigned char *rec = mappedRecord(&mf, i);
+            LogEntry e;
+            if (!rec) continue;
+            decodeLog(rec, &e, 1);
+            addLog(e.studentIndex, e.username, e.bookId, e.action, e.timestamp, 0);
+        }
+        logsSeq = mf.seq;
+        unmapDataFile(&mf);
+    } else if (rc > 0) {
+        FILE *fp = fopen("logs.dat", "rb");
+        if (!fp) return;
+        loadLegacyLogs(fp);
+        fclose(fp);
+    } else {
+        fprintf(stderr, "[!] Refusing to start with a damaged logs.dat; restore it from a backup.\n");
+        exit(1);
+    }
+    legacyLogsImported = 1;
+}
+
+// Rewrites a log file from before stable book ids in the current format.
+// Entries keep their positions, so log indices do not change.
+static int upgradeLogFile(const char *path) {
+    if (dataFileVersion(path, LOG_FILE_MAGIC) != 2) return 0;
+    MappedFile mf;
+    if (mapDataFile(path, LOG_FILE_MAGIC, 2, DISK_LOG_SIZE_V2, &mf) != 0) return -1;
+    LogSegment *seg = xrealloc(NULL, sizeof(LogSegment));
+    seg->number = (int)mf.extra[0];
+    seg->count = 0;
+    for (uint64_t i = 0; i < mf.count && i < LOG_SEGMENT_ENTRIES; i++) {
+        const unsigned char *rec = mappedRecord(&mf, i);
+        LogEntry *e = &seg->entries[seg->count++];
+        if (rec) {
+            decodeLog(rec, e, 2);
+        } else {
+            memset(e, 0, sizeof(*e));
+            strcpy(e->action, "Damaged");
+        }
+    }
+    uint64_t seq = mf.seq;
+    unmapDataFile(&mf);
+    int rc = writeSegment(seg, path, seq);
+    free(seg);
+    return rc;
+}
+
+// Indexes the sealed segments from their headers only and loads the
+// unsealed tail from logs/active.dat.
+void loadLogStore() {
+    uint64_t start = metricStart();
+    if (mkdir(LOG_DIR, 0755) != 0 && errno != EEXIST) perror(LOG_DIR);
+
+    int *numbers = NULL, count = 0, cap = 0;
+    DIR *dir = opendir(LOG_DIR);
+    struct dirent *ent;
+    while (dir && (ent = readdir(dir)) != NULL) {
+        int number;
+        char tail;
+        if (sscanf(ent->d_name, "segment-%d.da%c", &number, &tail) != 2 || tail != 't') continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            numbers = xrealloc(numbers, sizeof(int) * (size_t)cap);
+        }
+        numbers[count++] = number;
+    }
+    if (dir) closedir(dir);
+    qsort(numbers, (size_t)count, sizeof(int), compareSegmentNumbers);
+
+    int nextNumber = 1;
+    for (int k = 0; k < count; k++) {
+        char path[64];
+        MappedFile mf;
+        segmentPath(path, sizeof(path), numbers[k]);
+        if (upgradeLogFile(path) != 0) fprintf(stderr, "[!] %s: could not upgrade log segment\n", path);
+        if (mapDataFile(path, LOG_FILE_MAGIC, LOG_FORMAT_VERSION, DISK_LOG_SIZE, &mf) != 0 || mf.count == 0) {
+            fprintf(stderr, "[!] %s: skipping unreadable log segment\n", path);
+            continue;
+        }
+        if (segmentCount == segmentCap) {
+            segmentCap = segmentCap ? segmentCap * 2 : 64;
+            segments = xrealloc(segments, sizeof(SegmentInfo) * (size_t)segmentCap);
+        }
+        SegmentInfo *info = &segments[segmentCount++];
+        info->number = numbers[k];
+        info->firstIndex = logCount;
+        info->count = (int)mf.count;
+        info->minTime = (time_t)mf.extra[1];
+        info->maxTime = (time_t)mf.extra[2];
+        info->lastSeq = mf.seq;
+        logCount += info->count;
+        if (mf.seq > logsSeq) logsSeq = mf.seq;
+        nextNumber = numbers[k] + 1;
+        unmapDataFile(&mf);
+    }
+    free(numbers);
+    activeSegment->number = nextNumber;
+
+    MappedFile mf;
+    if (upgradeLogFile(LOG_DIR "/active.dat") != 0) fprintf(stderr, "[!] " LOG_DIR "/active.dat: could not upgrade\n");
+    int rc = mapDataFile(LOG_DIR "/active.dat", LOG_FILE_MAGIC, LOG_FORMAT_VERSION, DISK_LOG_SIZE, &mf);
+    if (rc == 0) {
+        // An active.dat older than the newest sealed segment is already in it.
+        if ((int)mf.extra[0] >= nextNumber) {
+            activeSegment->number = (int)mf.extra[0];
+            for (uint64_t i = 0; i < mf.count && i < LOG_SEGMENT_ENTRIES; i++) {
+                const unsigned char *rec = mappedRecord(&mf, i);
+                LogEntry *e = &activeSegment->entries[activeSegment->count];
+                if (!rec) continue;
+                decodeLog(rec, e, LOG_FORMAT_VERSION);
+                activeSegment->count++;
+                logCount++;
+            }
+            if (mf.seq > logsSeq) logsSeq = mf.seq;
+        }
+        unmapDataFile(&mf);
+    } else if (segmentCount == 0) {
+        importLegacyLogs();
+    }
+    metricEnd(METRIC_LOAD_LOGS, start, 1);
+}
+
+// --- Student data management ---
+// Snapshots students and logs as of journal record 'seq'. Callers hold the
+// write side of stateLock.
+static int writeSnapshot(uint64_t seq) {
+    uint64_t start = metricStart();
+    int rc = -1;
+    if (writeDataFile("students.dat", IO_STUDENTS, STUDENT_FILE_MAGIC, STUDENT_FORMAT_VERSION, 0,
+                      studentCount, seq, NULL, studentRecordSize, encodeStudent, students) == 0) {
+        studentsSeq = seq;
+        if (writeActiveSegment(seq) == 0) {
+            logsSeq = seq;
+            rc = 0;
+        }
+    }
+    metricEnd(METRIC_SNAPSHOT, start, rc == 0);
+    return rc;
+}
+
+// Reads the raw-struct students.dat layouts written by earlier versions.
+// Returns -1 if plaintext passwords could not be salted.
+static int loadLegacyStudents(FILE *fp) {
+    int count = 0, magic = 0;
+    int plaintext = fread(&magic, sizeof(int), 1, fp) == 1 &&
+                    magic != STUDENTS_MAGIC_V3 && magic != STUDENTS_MAGIC_V2;
+    if (plaintext) count = magic;
+    int ok = plaintext || fread(&count, sizeof(int), 1, fp) == 1;
+    if (ok && magic == STUDENTS_MAGIC_V3)
+        ok = fread(&studentsSeq, sizeof(uint64_t), 1, fp) == 1;
+    if (!ok || count <= 0) return 0;
+
+    // Grow as records are actually read rather than trusting the count.
+    LegacyHashedStudent st;
+    LegacyStudent old;
+    char (*passwords)[PASSWORD_LENGTH] = NULL;
+    int *owners = NULL, pending = 0, pendingCap = 0;
+    while (studentCount < count) {
+        if (plaintext) {
+            if (fread(&old, sizeof(old), 1, fp) != 1) break;
+            memset(&st, 0, sizeof(st));
+            memcpy(st.username, old.username, sizeof(st.username));
+            memcpy(st.issuedBooks, old.issuedBooks, sizeof(st.issuedBooks));
+            st.issuedBookCount = old.issuedBookCount;
+        } else if (fread(&st, sizeof(st), 1, fp) != 1) {
+            break;
+        }
+        if (st.issuedBookCount < 0 || st.issuedBookCount > LEGACY_LOANS_PER_STUDENT) break;
+        st.username[sizeof(st.username) - 1] = '\0';
+        int i = addStudent(st.username);
+        Student *dst = &students[i];
+        if (plaintext) {
+            if (pending == pendingCap) {
+                pendingCap = pendingCap ? pendingCap * 2 : 64;
+                passwords = xrealloc(passwords, sizeof(*passwords) * (size_t)pendingCap);
+                owners = xrealloc(owners, sizeof(int) * (size_t)pendingCap);
+            }
+            memcpy(passwords[pending], old.password, PASSWORD_LENGTH);
+            passwords[pending][PASSWORD_LENGTH - 1] = '\0';
+            owners[pending++] = i;
+            memset(&old, 0, sizeof(old));
+        } else {
+            memcpy(dst->salt, st.salt, SALT_LENGTH);
+            memcpy(dst->passwordHash, st.passwordHash, HASH_LENGTH);
+            dst->kdfIterations = st.kdfIterations;
+        }
+        for (int j = 0; j < st.issuedBookCount; j++) {
+            const LegacyIssuedBook *src = &st.issuedBooks[j];
+            IssuedBook ib = {0};
+            char title[sizeof(src->bookName)];
+            memcpy(title, src->bookName, sizeof(title));
+            title[sizeof(title) - 1] = '\0';
+            ib.bookId = legacyBookId(src->streamIndex, src->subjectIndex, src->bookIndex, title);
+            ib.isReturned = src->isReturned;
+            ib.issueDate = src->issueDate;
+            ib.dueDate = src->dueDate;
+            ib.returnDate = src->returnDate;
+            studentAddLoan(dst, &ib);
+        }
+    }
+
+    // Plaintext passwords from older versions are hashed once here, all
+    // queued on the KDF pool together rather than one after another.
+    int rc = 0;
+    KdfJob *jobs = xrealloc(NULL, sizeof(KdfJob) * (size_t)(pending + 1));
+    for (int k = 0; k < pending && rc == 0; k++) {
+        Student *dst = &students[owners[k]];
+        if (randomSalt(dst->salt) != 0) rc = -1;
+        dst->kdfIterations = (uint32_t)config.kdfIterations;
+        jobs[k] = (KdfJob){ .password = passwords[k], .salt = dst->salt, .iterations = dst->kdfIterations };
+    }
+    for (int k = 0; k < pending && rc == 0; k++) kdfSubmit(&jobs[k]);
+    for (int k = 0; k < pending && rc == 0; k++) {
+        kdfWait(&jobs[k]);
+        memcpy(students[owners[k]].passwordHash, jobs[k].out, HASH_LENGTH);
+    }
+    if (pending) memset(passwords, 0, sizeof(*passwords) * (size_t)pending);
+    free(passwords);
+    free(owners);
+    free(jobs);
+    return rc;
+}
+
+void loadStudents() {
+    uint64_t start = metricStart();
+    MappedFile mf;
+    int version = dataFileVersion("students.dat", STUDENT_FILE_MAGIC);
+    if (version < 1 || version > 3) version = STUDENT_FORMAT_VERSION;
+    uint32_t recordSize = version == 1 ? DISK_STUDENT_SIZE_V1 : version == 2 ? DISK_STUDENT_SIZE_V2 : 0;
+    int rc = mapDataFile("students.dat", STUDENT_FILE_MAGIC, version, recordSize, &mf);
+    if (rc == 0) {
+        // Students are mutable, so their records are decoded into memory.
+        // Journal records and logs refer to students by position, so a
+        // damaged record cannot simply be skipped.
+        students = xrealloc(students, sizeof(Student) * (size_t)(mf.count + 1));
+        studentCap = (int)mf.count + 1;
+        size_t offset = 0;
+        for (uint64_t i = 0; i < mf.count; i++) {
+            uint32_t size = recordSize - 4;
+            const unsigned char *rec = recordSize ? mappedRecord(&mf, i) : mappedNextRecord(&mf, &offset, &size);
+            if (!rec || decodeStudent(rec, size, &students[studentCount], version) != 0) {
+                fprintf(stderr, "[!] students.dat: record %llu is damaged\n", (unsigned long long)i + 1);
+                rc = -1;
+                break;
+            }
+            studentCount++;
+        }
+        studentsSeq = mf.seq;
+        metricIo(IO_STUDENTS, mf.size, 0);
+        unmapDataFile(&mf);
+    } else if (rc > 0) {
+        FILE *fp = fopen("students.dat", "rb");
+        if (fp) {
+            if (loadLegacyStudents(fp) != 0) {
+                fprintf(stderr, "[!] No secure random source for password salts; cannot convert students.dat.\n");
+                exit(1);
+            }
+            fclose(fp);
+        }
+    }
+    if (rc < 0) {
+        // Starting anyway would overwrite the file with partial data.
+        fprintf(stderr, "[!] Refusing to start with a damaged students.dat; restore it from a backup.\n");
+        exit(1);
+    }
+    rebuildStudentIndex();
+    metricEnd(METRIC_LOAD_STUDENTS, start, 1);
+}
+
+// Per-book available copies are only changed atomically so concurrent
+// issues can never take more copies than exist.
+int stockTake(int id) {
+    int n = __atomic_load_n(&lib.quantity[id], __ATOMIC_RELAXED);
+    while (n > 0) {
+        if (__atomic_compare_exchange_n(&lib.quantity[id], &n, n - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            browseMarkStock(id);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void stockGive(int id) {
+    __atomic_fetch_add(&lib.quantity[id], 1, __ATOMIC_RELEASE);
+    browseMarkStock(id);
+}
+
+int stockLevel(int id) {
+    return __atomic_load_n(&lib.quantity[id], __ATOMIC_ACQUIRE);
+}
+
+void lockStudent(int studentIndex) {
+    pthread_mutex_lock(&studentLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+}
+
+void unlockStudent(int studentIndex) {
+    pthread_mutex_unlock(&studentLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+}
+
+// --- Due-date index ---
+// Outstanding loans sit in a binary min-heap on due date. Each loan holds a
+// handle to its heap position, so a return removes it in O(log n), and the overdue
+// loans form a subtree at the top of the heap that can be walked in time
+// proportional to their number.
+static pthread_mutex_t dueLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void dueSet(int i, DueEntry e) {
+    dueIdx.heap[i] = e;
+    dueIdx.pos[e.handle] = i;
+}
+
+static void dueSiftUp(int i) {
+    DueEntry e = dueIdx.heap[i];
+    while (i > 0 && dueIdx.heap[(i - 1) / 2].dueDate > e.dueDate) {
+        dueSet(i, dueIdx.heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    dueSet(i, e);
+}
+
+static void dueSiftDown(int i) {
+    DueEntry e = dueIdx.heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= dueIdx.count) break;
+        if (child + 1 < dueIdx.count && dueIdx.heap[child + 1].dueDate < dueIdx.heap[child].dueDate) child++;
+        if (dueIdx.heap[child].dueDate >= e.dueDate) break;
+        dueSet(i, dueIdx.heap[child]);
+        i = child;
+    }
+    dueSet(i, e);
+}
+
+void dueIndexAdd(int student, int slot, time_t dueDate) {
+    pthread_mutex_lock(&dueLock);
+    if (dueIdx.count == dueIdx.cap) {
+        dueIdx.cap = dueIdx.cap ? dueIdx.cap * 2 : 256;
+        dueIdx.heap = xrealloc(dueIdx.heap, sizeof(DueEntry) * (size_t)dueIdx.cap);
+        dueIdx.freeHandles = xrealloc(dueIdx.freeHandles, sizeof(int) * (size_t)dueIdx.cap);
+    }
+    // Handles start at 1 so a zeroed loan has none.
+    int handle = dueIdx.freeCount ? dueIdx.freeHandles[--dueIdx.freeCount] : dueIdx.count + 1;
+    if (handle >= dueIdx.posCap) {
+        dueIdx.posCap = dueIdx.posCap ? dueIdx.posCap * 2 : 256;
+        dueIdx.pos = xrealloc(dueIdx.pos, sizeof(int) * (size_t)dueIdx.posCap);
+    }
+    students[student].loans[slot].dueHandle = handle;
+    dueIdx.heap[dueIdx.count++] = (DueEntry){ dueDate, student, slot, handle };
+    dueSiftUp(dueIdx.count - 1);
+    pthread_mutex_unlock(&dueLock);
+}
+
+void dueIndexRemove(int student, int slot) {
+    pthread_mutex_lock(&dueLock);
+    IssuedBook *ib = &students[student].loans[slot];
+    if (ib->dueHandle) {
+        int i = dueIdx.pos[ib->dueHandle];
+        dueIdx.freeHandles[dueIdx.freeCount++] = ib->dueHandle;
+        ib->dueHandle = 0;
+        DueEntry last = dueIdx.heap[--dueIdx.count];
+        if (i < dueIdx.count) {
+            dueSet(i, last);
+            if (i > 0 && dueIdx.heap[(i - 1) / 2].dueDate > last.dueDate) dueSiftUp(i);
+            else dueSiftDown(i);
+        }
+    }
+    pthread_mutex_unlock(&dueLock);
+}
+
+static int compareDueEntries(const void *a, const void *b) {
+    const DueEntry *x = a, *y = b;
+    if (x->dueDate != y->dueDate) return x->dueDate < y->dueDate ? -1 : 1;
+    return x->student - y->student;
+}
+
+// Loans due before 'asOf', oldest first, in an array from 'arena'. If
+// totalFine is given it receives the fines those loans have run up.
+int dueIndexOverdue(Arena *arena, time_t asOf, DueEntry **out, long long *totalFine) {
+    pthread_mutex_lock(&dueLock);
+    int n = 0, cap = 16, top = 0;
+    int *stack = arenaAlloc(arena, sizeof(int) * (size_t)(dueIdx.count + 1));
+    DueEntry *result = arenaAlloc(arena, sizeof(DueEntry) * (size_t)cap);
+    if (dueIdx.count) stack[top++] = 0;
+    while (top) {
+        int i = stack[--top];
+        if (dueIdx.heap[i].dueDate >= asOf) continue;   // nothing below is overdue either
+        if (n == cap) {
+            result = arenaGrow(arena, result, sizeof(DueEntry) * (size_t)cap, sizeof(DueEntry) * (size_t)cap * 2);
+            cap *= 2;
+        }
+        result[n++] = dueIdx.heap[i];
+        if (2 * i + 1 < dueIdx.count) stack[top++] = 2 * i + 1;
+        if (2 * i + 2 < dueIdx.count) stack[top++] = 2 * i + 2;
+    }
+    pthread_mutex_unlock(&dueLock);
+
+    qsort(result, (size_t)n, sizeof(DueEntry), compareDueEntries);
+    if (totalFine) {
+        *totalFine = 0;
+        for (int k = 0; k < n; k++) *totalFine += calculateFine(result[k].dueDate, asOf);
+    }
+    *out = result;
+    return n;
+}
+
+// books.csv holds the stock the library owns; copies out on loan or set
+// aside for a hold are taken off once the students are loaded, and the loans
+// enter the due-date index.
+void reconcileInventory() {
+    for (int i = 0; i < studentCount; i++) {
+        for (int k = 0; k < students[i].activeCount; k++) {
+            int j = students[i].active[k];
+            IssuedBook *ib = &students[i].loans[j];
+            int id = catalogRowById(ib->bookId);
+            if (id >= 0) {
+                lib.quantity[id]--;
+                browseMarkStock(id);
+            }
+            dueIndexAdd(i, j, ib->dueDate);
+        }
+        for (int k = 0; k < students[i].holdCount; k++) {
+            int id = catalogRowById(students[i].holds[k].bookId);
+            if (id >= 0 && students[i].holds[k].ready) {
+                lib.quantity[id]--;
+                browseMarkStock(id);
+            }
+        }
+    }
+    rebuildHoldQueues();
+}
+
+// The apply* functions change in-memory state only; both the menus and
+// journal replay go through them.
+int applySignup(const char *username, const unsigned char *salt, const unsigned char *hash, uint32_t iterations) {
+    int i = addStudent(username);
+    memcpy(students[i].salt, salt, SALT_LENGTH);
+    memcpy(students[i].passwordHash, hash, HASH_LENGTH);
+    students[i].kdfIterations = iterations;
+    return i;
+}
+
+// Records a loan without touching stock. Returns the loan slot used, or -1
+// if the book is gone. The loan limit is policy and is checked when the
+// issue is first made, not on replay.
+static int recordLoan(int studentIndex, uint32_t bookId, time_t issueDate, time_t dueDate) {
+    if (catalogRowById(bookId) < 0) return -1;
+    IssuedBook ib = { bookId, 0, issueDate, dueDate, 0, 0 };
+    int slot = studentAddLoan(&students[studentIndex], &ib);
+    dueIndexAdd(studentIndex, slot, dueDate);
+    return slot;
+}
+
+// Replay path: the stock was already checked when the issue first happened.
+// A copy set aside for the student's hold is used before the shelf.
+int applyIssue(int studentIndex, uint32_t bookId, time_t issueDate, time_t dueDate) {
+    int slot = recordLoan(studentIndex, bookId, issueDate, dueDate);
+    if (slot >= 0 && !holdClaim(studentIndex, bookId)) {
+        int id = catalogRowById(bookId);
+        __atomic_fetch_sub(&lib.quantity[id], 1, __ATOMIC_RELAXED);
+        browseMarkStock(id);
+    }
+    return slot;
+}
+
+// Marks an outstanding loan returned; where the copy goes is up to the caller.
+static void loanClose(int studentIndex, int slot, time_t returnDate) {
+    IssuedBook *ib = &students[studentIndex].loans[slot];
+    dueIndexRemove(studentIndex, slot);
+    studentDeactivate(&students[studentIndex], slot);
+    ib->isReturned = 1;
+    ib->returnDate = returnDate;
+}
+
+int applyReturn(int studentIndex, int slot, time_t returnDate) {
+    Student *student = &students[studentIndex];
+    if (slot < 0 || slot >= student->loanCount || student->loans[slot].isReturned) return -1;
+    holdPassCopy(student->loans[slot].bookId, returnDate);
+    loanClose(studentIndex, slot, returnDate);
+    return 0;
+}
+
+// --- Holds ---
+// A student can queue for a title with no copy on the shelf. Each title keeps
+// its waiting holders in a ring buffer in the order they asked, so joining the
+// queue and serving its front are O(1) however long it grows; a cancelled
+// hold stays in the ring and is skipped when it reaches the front. A returned
+// copy is set aside for the first live holder, who has config.pickupDays to
+// borrow it before it passes on.
+//
+// A title's queue, and the ready flag and deadline of each hold on it, are
+// guarded by the title's stripe of holdLocks, and hold changes are journaled
+// under it, so a title's holds change in journal order. A student's list of
+// holds is guarded by its stripe of holdListLocks, which is always taken last
+// and held only briefly. 'holders' is read without a lock: issues and returns
+// of a title nobody holds never touch the hold locks at all.
+typedef struct {
+    int student;
+    uint64_t ticket;        // stale once the student's hold has another ticket
+} HoldEntry;
+
+typedef struct {
+    HoldEntry *ring;        // power-of-two capacity
+    int head, count, cap;
+    int waiting;            // entries in the ring that are still live
+    int *ready;             // students with a copy set aside, unordered
+    int readyCount, readyCap;
+    int holders;            // live holds, waiting or ready; atomic
+} HoldQueue;
+
+static HoldQueue *holdQueues = NULL;   // indexed by catalog row
+static int holdQueueCap = 0;
+
+// Called for every catalog row as it is added, so the array never moves
+// under a reader holding only the read side of stateLock.
+void holdReserve(int id) {
+    if (id < holdQueueCap) return;
+    int cap = holdQueueCap ? holdQueueCap : 256;
+    while (cap <= id) cap *= 2;
+    holdQueues = xrealloc(holdQueues, sizeof(HoldQueue) * (size_t)cap);
+    memset(holdQueues + holdQueueCap, 0, sizeof(HoldQueue) * (size_t)(cap - holdQueueCap));
+    holdQueueCap = cap;
+}
+
+static HoldQueue *holdQueue(uint32_t bookId) {
+    int id = catalogRowById(bookId);
+    return id >= 0 ? &holdQueues[id] : NULL;
+}
+
+// Whether anyone holds the book at catalog row id.
+static int holdActive(int id) {
+    return id >= 0 && __atomic_load_n(&holdQueues[id].holders, __ATOMIC_ACQUIRE) > 0;
+}
+
+static void holdLockBook(uint32_t bookId) {
+    pthread_mutex_lock(&holdLocks[bookId % HOLD_LOCK_STRIPES]);
+}
+
+static void holdUnlockBook(uint32_t bookId) {
+    pthread_mutex_unlock(&holdLocks[bookId % HOLD_LOCK_STRIPES]);
+}
+
+// Copies the student's hold on a book to *out. Returns -1 if there is none.
+static int holdGet(int studentIndex, uint32_t bookId, StudentHold *out) {
+    pthread_mutex_lock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    const StudentHold *h = studentHold(&students[studentIndex], bookId);
+    if (h) *out = *h;
+    pthread_mutex_unlock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    return h ? 0 : -1;
+}
+
+static void holdEnqueue(HoldQueue *q, int student, uint64_t ticket) {
+    if (q->count == q->cap) {
+        int cap = q->cap ? q->cap * 2 : 8;
+        HoldEntry *ring = xrealloc(NULL, sizeof(HoldEntry) * (size_t)cap);
+        for (int i = 0; i < q->count; i++) ring[i] = q->ring[(q->head + i) & (q->cap - 1)];
+        free(q->ring);
+        q->ring = ring;
+        q->head = 0;
+        q->cap = cap;
+    }
+    q->ring[(q->head + q->count++) & (q->cap - 1)] = (HoldEntry){ student, ticket };
+    q->waiting++;
+}
+
+static int holdEntryLive(const HoldEntry *e, uint32_t bookId) {
+    StudentHold h;
+    return holdGet(e->student, bookId, &h) == 0 && !h.ready && h.ticket == e->ticket;
+}
+
+// One waiting hold has gone; an empty queue drops its stale entries.
+static void holdLeaveQueue(HoldQueue *q) {
+    if (--q->waiting == 0) q->head = q->count = 0;
+}
+
+static void holdReadyAdd(HoldQueue *q, int student) {
+    if (q->readyCount == q->readyCap) {
+        q->readyCap = q->readyCap ? q->readyCap * 2 : 4;
+        q->ready = xrealloc(q->ready, sizeof(int) * (size_t)q->readyCap);
+    }
+    q->ready[q->readyCount++] = student;
+}
+
+static void holdReadyRemove(HoldQueue *q, int student) {
+    for (int k = 0; k < q->readyCount; k++) {
+        if (q->ready[k] == student) {
+            q->ready[k] = q->ready[--q->readyCount];
+            return;
+        }
+    }
+}
+
+// Sets a returned copy aside for the next live holder, or puts it back on the
+// shelf when nobody is waiting.
+static void holdPassCopy(uint32_t bookId, time_t when) {
+    HoldQueue *q = holdQueue(bookId);
+    while (q && q->waiting) {
+        HoldEntry e = q->ring[q->head];
+        q->head = (q->head + 1) & (q->cap - 1);
+        q->count--;
+        pthread_mutex_lock(&holdListLocks[e.student % STUDENT_LOCK_STRIPES]);
+        StudentHold *h = studentHold(&students[e.student], bookId);
+        int live = h && !h->ready && h->ticket == e.ticket;
+        if (live) {
+            h->ready = 1;
+            h->time = when + (time_t)config.pickupDays * 24 * 60 * 60;
+        }
+        pthread_mutex_unlock(&holdListLocks[e.student % STUDENT_LOCK_STRIPES]);
+        if (!live) continue;
+        holdLeaveQueue(q);
+        holdReadyAdd(q, e.student);
+        return;
+    }
+    int id = catalogRowById(bookId);
+    if (id >= 0) stockGive(id);
+}
+
+int applyHoldPlace(int studentIndex, uint32_t bookId, time_t placed, uint64_t ticket) {
+    Student *st = &students[studentIndex];
+    HoldQueue *q = holdQueue(bookId);
+    if (!q) return -1;
+    pthread_mutex_lock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    int held = studentHold(st, bookId) != NULL;
+    if (!held) {
+        StudentHold h = { bookId, 0, ticket, placed };
+        studentAddHold(st, &h);
+    }
+    pthread_mutex_unlock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    if (held) return -1;
+    holdEnqueue(q, studentIndex, ticket);
+    __atomic_fetch_add(&q->holders, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Drops the student's hold on a book. Returns -1 if there is none, else
+// whether a copy had been set aside for it.
+static int holdDrop(int studentIndex, uint32_t bookId) {
+    Student *st = &students[studentIndex];
+    pthread_mutex_lock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    StudentHold *h = studentHold(st, bookId);
+    int ready = h ? h->ready : -1;
+    if (h) studentDropHold(st, h);
+    pthread_mutex_unlock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    HoldQueue *q = ready >= 0 ? holdQueue(bookId) : NULL;
+    if (q) {
+        if (ready) holdReadyRemove(q, studentIndex);
+        else holdLeaveQueue(q);
+        __atomic_fetch_sub(&q->holders, 1, __ATOMIC_RELEASE);
+    }
+    return ready;
+}
+
+// Ends a hold, cancelled or expired. A copy set aside for it passes on.
+int applyHoldCancel(int studentIndex, uint32_t bookId, time_t when) {
+    int ready = holdDrop(studentIndex, bookId);
+    if (ready > 0) holdPassCopy(bookId, when);
+    return ready < 0 ? -1 : 0;
+}
+
+// A student borrowing a book no longer needs a hold on it. Returns 1 if a
+// copy had been set aside for them, which the loan then uses.
+static int holdClaim(int studentIndex, uint32_t bookId) {
+    return holdDrop(studentIndex, bookId) > 0;
+}
+
+static int compareHoldTickets(const void *a, const void *b) {
+    const HoldEntry *x = a, *y = b;
+    return x->ticket < y->ticket ? -1 : x->ticket > y->ticket;
+}
+
+// Queues the holds loaded from students.dat again, in ticket order.
+void rebuildHoldQueues() {
+    int n = 0;
+    for (int i = 0; i < studentCount; i++) n += students[i].holdCount;
+    HoldEntry *waiting = xrealloc(NULL, sizeof(HoldEntry) * (size_t)(n + 1));
+    n = 0;
+    for (int i = 0; i < studentCount; i++) {
+        for (int k = 0; k < students[i].holdCount; k++) {
+            StudentHold *h = &students[i].holds[k];
+            HoldQueue *q = holdQueue(h->bookId);
+            if (!q) continue;
+            q->holders++;
+            if (h->ready) holdReadyAdd(q, i);
+            else waiting[n++] = (HoldEntry){ i, h->ticket };
+        }
+    }
+    // Tickets are journal sequence numbers, so they order holds across books.
+    qsort(waiting, (size_t)n, sizeof(HoldEntry), compareHoldTickets);
+    for (int k = 0; k < n; k++) {
+        Student *st = &students[waiting[k].student];
+        for (int j = 0; j < st->holdCount; j++)
+            if (st->holds[j].ticket == waiting[k].ticket)
+                holdEnqueue(holdQueue(st->holds[j].bookId), waiting[k].student, waiting[k].ticket);
+    }
+    free(waiting);
+}
+
+// 1-based place of the student's waiting hold in its queue, 0 if the hold is
+// ready or missing.
+int holdPosition(int studentIndex, uint32_t bookId) {
+    int place = 0, found = 0;
+    StudentHold h;
+    pthread_rwlock_rdlock(&stateLock);
+    const HoldQueue *q = holdQueue(bookId);
+    holdLockBook(bookId);
+    if (q && holdGet(studentIndex, bookId, &h) == 0 && !h.ready) {
+        for (int i = 0; i < q->count && !found; i++) {
+            const HoldEntry *e = &q->ring[(q->head + i) & (q->cap - 1)];
+            if (holdEntryLive(e, bookId)) place++;
+            found = e->student == studentIndex && e->ticket == h.ticket;
+        }
+    }
+    holdUnlockBook(bookId);
+    pthread_rwlock_unlock(&stateLock);
+    return found ? place : 0;
+}
+
+// Students waiting for a book.
+int holdWaiting(uint32_t bookId) {
+    pthread_rwlock_rdlock(&stateLock);
+    const HoldQueue *q = holdQueue(bookId);
+    holdLockBook(bookId);
+    int waiting = q ? q->waiting : 0;
+    holdUnlockBook(bookId);
+    pthread_rwlock_unlock(&stateLock);
+    return waiting;
+}
+
+// --- Journal ---
+// Every mutation is appended to journal.dat as
+//   [u32 payload length][u32 CRC-32 of payload][payload]
+// and the payload starts with a record type and a sequence number. A flusher
+// thread writes whatever has accumulated with one fdatasync (group commit),
+// and a compaction thread periodically folds the journal into students.dat
+// and logs.dat and truncates it.
+// JOURNAL_ISSUE_AT records name the book by catalog position and are only
+// replayed from journals written before stable book ids.
+enum {
+    JOURNAL_SIGNUP = 1, JOURNAL_ISSUE_AT = 2, JOURNAL_RETURN = 3, JOURNAL_ISSUE = 4,
+    JOURNAL_HOLD = 5, JOURNAL_HOLD_CANCEL = 6, JOURNAL_HOLD_EXPIRE = 7
+};
+
+typedef struct {
+    unsigned char data[JOURNAL_MAX_RECORD];
+    size_t len;
+} RecordWriter;
+
+typedef struct {
+    const unsigned char *p;
+    size_t left;
+    int ok;
+} RecordReader;
+
+static void putBytes(RecordWriter *w, const void *src, size_t len) {
+    if (w->len + len > sizeof(w->data)) return;
+    memcpy(w->data + w->len, src, len);
+    w->len += len;
+}
+
+static void putU32(RecordWriter *w, uint32_t v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    putBytes(w, b, 4);
+}
+
+static void putU64(RecordWriter *w, uint64_t v) {
+    putU32(w, (uint32_t)v);
+    putU32(w, (uint32_t)(v >> 32));
+}
+
+static void getBytes(RecordReader *r, void *dst, size_t len) {
+    if (!r->ok || r->left < len) {
+        r->ok = 0;
+        memset(dst, 0, len);
+        return;
+    }
+    memcpy(dst, r->p, len);
+    r->p += len;
+    r->left -= len;
+}
+
+static uint32_t getU32(RecordReader *r) {
+    unsigned char b[4];
+    getBytes(r, b, 4);
+    return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static uint64_t getU64(RecordReader *r) {
+    uint64_t lo = getU32(r);
+    return lo | (uint64_t)getU32(r) << 32;
+}
+
+uint32_t crc32(const unsigned char *data, size_t len) {
+    static uint32_t table[256];
+    static int ready = 0;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        ready = 1;
+    }
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journalPending = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t journalDurable = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t journalCompactWake = PTHREAD_COND_INITIALIZER;
+static int journalFd = -1;
+static unsigned char *journalBuf = NULL, *journalFlushBuf = NULL;
+static size_t journalBufLen = 0, journalBufCap = 0, journalFlushCap = 0;
+static uint64_t journalSeq = 0;         // last sequence number handed out
+static uint64_t journalDurableSeq = 0;  // last sequence number known to be on disk
+static size_t journalBytes = 0;        // length of the journal known to be good
+static int journalFailed = 0;           // a batch was lost; cleared by the next snapshot
+static int journalNotifyFd = -1;        // eventfd poked after every fdatasync
+
+static void applyJournalRecord(int type, RecordReader *r, uint64_t seq) {
+    int applyState = seq > studentsSeq, applyLog = seq > logsSeq;
+
+    if (type == JOURNAL_SIGNUP) {
+        char username[50] = "";
+        unsigned char len, salt[SALT_LENGTH], hash[HASH_LENGTH];
+        getBytes(r, &len, 1);
+        if (len >= sizeof(username)) r->ok = 0;
+        else getBytes(r, username, len);
+        getBytes(r, salt, SALT_LENGTH);
+        getBytes(r, hash, HASH_LENGTH);
+        uint32_t iterations = getU32(r);
+        if (r->ok && applyState && findStudent(username) < 0)
+            applySignup(username, salt, hash, iterations);
+    } else if (type == JOURNAL_ISSUE || type == JOURNAL_ISSUE_AT) {
+        int st = (int)getU32(r);
+        uint32_t bookId;
+        if (type == JOURNAL_ISSUE) {
+            bookId = getU32(r);
+        } else {
+            int s = (int)getU32(r), sub = (int)getU32(r), b = (int)getU32(r);
+            int id = catalogBookAt(s, sub, b);
+            bookId = id >= 0 ? lib.bookId[id] : 0;
+        }
+        time_t issueDate = (time_t)getU64(r), dueDate = (time_t)getU64(r);
+        if (!r->ok || st < 0 || st >= studentCount) return;
+        if (applyState) applyIssue(st, bookId, issueDate, dueDate);
+        if (applyLog && catalogRowById(bookId) >= 0)
+            addLog(st, students[st].username, bookId, "Issued", issueDate, seq);
+    } else if (type == JOURNAL_RETURN) {
+        int st = (int)getU32(r), slot = (int)getU32(r);
+        time_t returnDate = (time_t)getU64(r);
+        if (!r->ok || st < 0 || st >= studentCount) return;
+        if (applyState) applyReturn(st, slot, returnDate);
+        if (applyLog && slot >= 0 && slot < students[st].loanCount)
+            addLog(st, students[st].username, students[st].loans[slot].bookId, "Returned", returnDate, seq);
+    } else if (type == JOURNAL_HOLD || type == JOURNAL_HOLD_CANCEL || type == JOURNAL_HOLD_EXPIRE) {
+        int st = (int)getU32(r);
+        uint32_t bookId = getU32(r);
+        time_t when = (time_t)getU64(r);
+        if (!r->ok || st < 0 || st >= studentCount) return;
+        if (applyState) {
+            if (type == JOURNAL_HOLD) applyHoldPlace(st, bookId, when, seq);
+            else applyHoldCancel(st, bookId, when);
+        }
+        if (applyLog && catalogRowById(bookId) >= 0)
+            addLog(st, students[st].username, bookId,
+                   type == JOURNAL_HOLD ? "Held" : type == JOURNAL_HOLD_CANCEL ? "Cancelled" : "Expired", when, seq);
+    }
+}
+
+// Re-applies journal records newer than the snapshots. A torn or corrupt
+// tail (from a crash mid-append) is cut off. Returns the records read.
+int replayJournal() {
+    int fd = open(JOURNAL_FILE, O_RDWR);
+    if (fd < 0) return 0;
+    FILE *fp = fdopen(dup(fd), "rb");
+    off_t good = 0;
+    int records = 0;
+    unsigned char header[8], payload[JOURNAL_MAX_RECORD];
+
+    journalSeq = studentsSeq > logsSeq ? studentsSeq : logsSeq;
+    while (fp && fread(header, 1, 8, fp) == 8) {
+        uint32_t len = loadLe32(header), crc = loadLe32(header + 4);
+        if (len < 9 || len > JOURNAL_MAX_RECORD || fread(payload, 1, len, fp) != len ||
+            crc32(payload, len) != crc)
+            break;
+        RecordReader r = { payload, len, 1 };
+        unsigned char type;
+        getBytes(&r, &type, 1);
+        uint64_t seq = getU64(&r);
+        applyJournalRecord(type, &r, seq);
+        if (seq > journalSeq) journalSeq = seq;
+        good += 8 + (off_t)len;
+        records++;
+    }
+    if (fp) fclose(fp);
+    if (lseek(fd, 0, SEEK_END) != good) {
+        fprintf(stderr, "[!] Discarding a damaged tail of %s after %d record(s).\n", JOURNAL_FILE, records);
+        if (ftruncate(fd, good) != 0) perror(JOURNAL_FILE);
+    }
+    journalBytes = (size_t)good;
+    journalDurableSeq = journalSeq;
+    metricIo(IO_JOURNAL, (uint64_t)good, 0);
+    close(fd);
+    return records;
+}
+
+static void *journalFlusher(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&journalLock);
+    while (1) {
+        while (journalBufLen == 0) pthread_cond_wait(&journalPending, &journalLock);
+
+        // Swap buffers so appends can continue while this batch is written.
+        unsigned char *batch = journalBuf;
+        size_t len = journalBufLen, cap = journalBufCap, good = journalBytes;
+        uint64_t seq = journalSeq;
+        int failed = journalFailed;
+        journalBuf = journalFlushBuf;
+        journalBufCap = journalFlushCap;
+        journalBufLen = 0;
+        journalFlushBuf = batch;
+        journalFlushCap = cap;
+        pthread_mutex_unlock(&journalLock);
+
+        // Once a batch is lost, later records would replay against state the
+        // journal no longer has, so they are dropped too until a snapshot.
+        size_t done = 0;
+        while (!failed && done < len) {
+            ssize_t n = write(journalFd, batch + done, len - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) break;
+            done += (size_t)n;
+        }
+        int ok = !failed && done == len && fdatasync(journalFd) == 0;
+        if (!failed && !ok) {
+            perror(JOURNAL_FILE);
+            // Cut off the partial batch so nothing is appended after a torn record.
+            if (ftruncate(journalFd, (off_t)good) != 0 || fdatasync(journalFd) != 0) perror(JOURNAL_FILE);
+        }
+        metricIo(IO_JOURNAL, 0, done);
+
+        pthread_mutex_lock(&journalLock);
+        if (ok) {
+            journalDurableSeq = seq;
+            journalBytes += len;
+        } else if (!failed) {
+            journalFailed = 1;
+            pthread_cond_signal(&journalCompactWake);   // a snapshot recovers
+        }
+        pthread_cond_broadcast(&journalDurable);
+        if (journalNotifyFd >= 0) {
+            uint64_t one = 1;
+            if (write(journalNotifyFd, &one, sizeof(one)) < 0) { /* counter saturated; a wakeup is pending */ }
+        }
+        if (journalBytes > JOURNAL_COMPACT_BYTES) pthread_cond_signal(&journalCompactWake);
+    }
+    return NULL;
+}
+
+static void *journalCompactor(void *arg) {
+    (void)arg;
+    int retryLater = 0;     // the last snapshot did not clear a journal failure
+    while (1) {
+        pthread_mutex_lock(&journalLock);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += JOURNAL_COMPACT_SECONDS;
+        while (journalBytes <= JOURNAL_COMPACT_BYTES && (!journalFailed || retryLater)) {
+            if (pthread_cond_timedwait(&journalCompactWake, &journalLock, &deadline) == ETIMEDOUT)
+                break;
+        }
+        size_t bytes = journalBytes;
+        int failed = journalFailed;
+        pthread_mutex_unlock(&journalLock);
+        if (bytes > 0 || failed) compactJournal();
+        pthread_mutex_lock(&journalLock);
+        retryLater = journalFailed;
+        pthread_mutex_unlock(&journalLock);
+    }
+    return NULL;
+}
+
+void journalOpen() {
+    journalFd = open(JOURNAL_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (journalFd < 0) {
+        perror(JOURNAL_FILE);
+        return;
+    }
+    pthread_t t;
+    if (pthread_create(&t, NULL, journalFlusher, NULL) == 0) pthread_detach(t);
+    if (pthread_create(&t, NULL, journalCompactor, NULL) == 0) pthread_detach(t);
+}
+
+// Queues one record and returns its sequence number. Callers hold historyLock
+// or the write side of stateLock so records and log entries stay in step.
+static uint64_t journalAppend(int type, RecordWriter *fields) {
+    RecordWriter rec = { .len = 0 };
+    unsigned char t = (unsigned char)type;
+    pthread_mutex_lock(&journalLock);
+    uint64_t seq = ++journalSeq;
+    putBytes(&rec, &t, 1);
+    putU64(&rec, seq);
+    putBytes(&rec, fields->data, fields->len);
+
+    if (journalFd >= 0) {
+        size_t need = journalBufLen + rec.len + 8;
+        if (need > journalBufCap) {
+            journalBufCap = need * 2;
+            journalBuf = xrealloc(journalBuf, journalBufCap);
+        }
+        unsigned char *out = journalBuf + journalBufLen;
+        uint32_t crc = crc32(rec.data, rec.len);
+        for (int i = 0; i < 4; i++) {
+            out[i] = (unsigned char)(rec.len >> (8 * i));
+            out[4 + i] = (unsigned char)(crc >> (8 * i));
+        }
+        memcpy(out + 8, rec.data, rec.len);
+        journalBufLen += rec.len + 8;
+        pthread_cond_signal(&journalPending);
+    } else {
+        journalDurableSeq = seq;
+    }
+    pthread_mutex_unlock(&journalLock);
+    return seq;
+}
+
+uint64_t journalSignup(int studentIndex) {
+    Student *st = &students[studentIndex];
+    RecordWriter w = { .len = 0 };
+    unsigned char len = (unsigned char)strlen(st->username);
+    putBytes(&w, &len, 1);
+    putBytes(&w, st->username, len);
+    putBytes(&w, st->salt, SALT_LENGTH);
+    putBytes(&w, st->passwordHash, HASH_LENGTH);
+    putU32(&w, st->kdfIterations);
+    return journalAppend(JOURNAL_SIGNUP, &w);
+}
+
+uint64_t journalIssue(int studentIndex, int slot) {
+    IssuedBook *ib = &students[studentIndex].loans[slot];
+    RecordWriter w = { .len = 0 };
+    putU32(&w, (uint32_t)studentIndex);
+    putU32(&w, ib->bookId);
+    putU64(&w, (uint64_t)ib->issueDate);
+    putU64(&w, (uint64_t)ib->dueDate);
+    return journalAppend(JOURNAL_ISSUE, &w);
+}
+
+uint64_t journalReturn(int studentIndex, int slot) {
+    RecordWriter w = { .len = 0 };
+    putU32(&w, (uint32_t)studentIndex);
+    putU32(&w, (uint32_t)slot);
+    putU64(&w, (uint64_t)students[studentIndex].loans[slot].returnDate);
+    return journalAppend(JOURNAL_RETURN, &w);
+}
+
+// JOURNAL_HOLD, JOURNAL_HOLD_CANCEL or JOURNAL_HOLD_EXPIRE.
+uint64_t journalHold(int type, int studentIndex, uint32_t bookId, time_t when) {
+    RecordWriter w = { .len = 0 };
+    putU32(&w, (uint32_t)studentIndex);
+    putU32(&w, bookId);
+    putU64(&w, (uint64_t)when);
+    return journalAppend(type, &w);
+}
+
+// Ends the holds on a book whose pickup deadline has passed, journaling each
+// as it goes. Callers hold the book's hold lock.
+static void expireHolds(uint32_t bookId, time_t now) {
+    HoldQueue *q = holdQueue(bookId);
+    for (int k = 0; q && k < q->readyCount; ) {
+        int s = q->ready[k];
+        StudentHold h;
+        if (holdGet(s, bookId, &h) != 0 || h.time >= now) {
+            k++;
+            continue;
+        }
+        pthread_mutex_lock(&historyLock);
+        uint64_t seq = journalHold(JOURNAL_HOLD_EXPIRE, s, bookId, now);
+        addLog(s, students[s].username, bookId, "Expired", now, seq);
+        pthread_mutex_unlock(&historyLock);
+        // Removing the hold moves another entry into slot k.
+        applyHoldCancel(s, bookId, now);
+    }
+}
+
+// Expires overdue pickups across the catalog, for the compaction thread. It
+// holds stateLock for writing, so no hold lock is needed.
+static void expireAllHolds(time_t now) {
+    for (int id = 0; id < lib.bookCount; id++)
+        if (holdQueues[id].readyCount) expireHolds(lib.bookId[id], now);
+}
+
+// Waits until record 'seq' and everything before it is on disk. Returns -1
+// if the journal could not be written, so the record may be lost.
+int journalCommit(uint64_t seq) {
+    uint64_t start = metricStart();
+    pthread_mutex_lock(&journalLock);
+    while (journalDurableSeq < seq && !journalFailed) pthread_cond_wait(&journalDurable, &journalLock);
+    int rc = journalDurableSeq >= seq ? 0 : -1;
+    pthread_mutex_unlock(&journalLock);
+    metricEnd(METRIC_COMMIT, start, rc == 0);
+    return rc;
+}
+
+// journalCommit for the menus, which tell the user if the change was lost.
+void journalCommitOrWarn(uint64_t seq) {
+    if (journalCommit(seq) != 0)
+        printf("\n[!] Could not save this change to disk; it will be lost if the program stops now.\n");
+}
+
+// *failed is set once records past the returned one can no longer be saved.
+uint64_t journalDurableSequence(int *failed) {
+    pthread_mutex_lock(&journalLock);
+    uint64_t seq = journalDurableSeq;
+    *failed = journalFailed;
+    pthread_mutex_unlock(&journalLock);
+    return seq;
+}
+
+void journalSetNotify(int fd) {
+    pthread_mutex_lock(&journalLock);
+    journalNotifyFd = fd;
+    pthread_mutex_unlock(&journalLock);
+}
+
+// Folds the journal into fresh students.dat/logs.dat snapshots and empties it.
+void compactJournal() {
+    pthread_rwlock_wrlock(&stateLock);
+    expireAllHolds(time(NULL));
+    pthread_mutex_lock(&journalLock);
+    uint64_t seq = journalSeq;
+    pthread_mutex_unlock(&journalLock);
+    journalCommit(seq);
+
+    // The snapshot holds everything in memory, including any records a
+    // failed journal write lost, so it also clears the failure.
+    if (writeSnapshot(seq) == 0 && journalFd >= 0) {
+        pthread_mutex_lock(&journalLock);
+        if (ftruncate(journalFd, 0) == 0 && fdatasync(journalFd) == 0) {
+            journalBytes = 0;
+            if (journalFailed) {
+                journalBufLen = 0;
+                journalDurableSeq = seq;
+                journalFailed = 0;
+                pthread_cond_broadcast(&journalDurable);
+            }
+        }
+        pthread_mutex_unlock(&journalLock);
+    } else if (journalFd >= 0) {
+        fprintf(stderr, "[!] Could not write snapshot; keeping the journal.\n");
+    }
+    pthread_rwlock_unlock(&stateLock);
+}
+
+// Short-lived commands leave the journal alone until it is worth folding.
+void compactJournalIfLarge() {
+    pthread_mutex_lock(&journalLock);
+    size_t bytes = journalBytes;
+    pthread_mutex_unlock(&journalLock);
+    if (bytes > JOURNAL_COMPACT_BYTES) compactJournal();
+}
+
+static void insertStudentSlot(uint32_t hash, int index) {
+    int j = (int)(hash & (uint32_t)(studentSlotCap - 1));
+    while (studentSlots[j].index) j = (j + 1) & (studentSlotCap - 1);
+    studentSlots[j].hash = hash;
+    studentSlots[j].index = index + 1;
+}
+
+void rebuildStudentIndex() {
+    int cap = 64;
+    while (cap * 3 < (studentCount + 1) * 4) cap *= 2;
+    free(studentSlots);
+    studentSlots = calloc((size_t)cap, sizeof(StudentSlot));
+    if (!studentSlots) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
+    }
+    studentSlotCap = cap;
+    for (int i = 0; i < studentCount; i++)
+        insertStudentSlot(hashString(students[i].username), i);
+}
+
+// Returns the index of the student with this username, or -1.
+int findStudent(const char *username) {
+    if (!studentSlotCap) return -1;
+    uint32_t hash = hashString(username);
+    int j = (int)(hash & (uint32_t)(studentSlotCap - 1));
+    while (studentSlots[j].index) {
+        if (studentSlots[j].hash == hash &&
+            strcmp(students[studentSlots[j].index - 1].username, username) == 0)
+            return studentSlots[j].index - 1;
+        j = (j + 1) & (studentSlotCap - 1);
+    }
+    return -1;
+}
+
+// Appends a new student and indexes it. Returns its index.
+int addStudent(const char *username) {
+    if (studentCount == studentCap) {
+        studentCap = studentCap ? studentCap * 2 : 64;
+        students = xrealloc(students, sizeof(Student) * (size_t)studentCap);
+    }
+    int i = studentCount++;
+    Student *st = &students[i];
+    memset(st, 0, sizeof(*st));
+    strncpy(st->username, username, sizeof(st->username) - 1);
+
+    if (studentCount * 4 > studentSlotCap * 3)
+        rebuildStudentIndex();
+    else
+        insertStudentSlot(hashString(st->username), i);
+    return i;
+}
+
+int usernameExists(const char* username) {
+    return findStudent(username) >= 0;
+}
+
+int validateStudentLogin(const char* username, const char* password) {
+    int i = findStudent(username);
+    if (i >= 0 && verifyStudentPassword(i, password))
+        return i; // return student index
+    return -1;
+}
+
+int validateAdminLogin(const char* username, const char* password) {
+    return strcmp(username, "admin") == 0 && strcmp(password, "Admin@123") == 0;
+}
+
+void signup() {
+    char username[50], password[PASSWORD_LENGTH], passwordConfirm[PASSWORD_LENGTH];
+    clearInput();
+    printHeader("Student Signup");
+    printf("Enter username: ");
+    fgets(username, sizeof(username), stdin);
+    username[strcspn(username, "\n")] = 0;
+
+    if (usernameExists(username)) {
+        printf("\n[!] Username already exists. Try logging in.\n");
+        waitForEnter();
+        return;
+    }
+
+    while (1) {
+        printf("Enter password: ");
+        getPassword(password, PASSWORD_LENGTH);
+        if (!isStrongPassword(password)) {
+            printf("[!] Password must be at least 8 characters long and include uppercase, lowercase, digit and special char.\n");
+            continue;
+        }
+        printf("Confirm password: ");
+        getPassword(passwordConfirm, PASSWORD_LENGTH);
+        if (strcmp(password, passwordConfirm) != 0) {
+            printf("[!] Passwords do not match. Try again.\n");
+            continue;
+        }
+        break;
+    }
+
+    // The derivation is slow, so it runs before the write lock is taken;
+    // issues and returns are blocked only while the record is added.
+    unsigned char salt[SALT_LENGTH], hash[HASH_LENGTH];
+    uint32_t iterations;
+    if (hashNewPassword(password, salt, hash, &iterations) != 0) {
+        printf("\n[!] No secure random source for the password salt; signup aborted.\n");
+        waitForEnter();
+        return;
+    }
+
+    pthread_rwlock_wrlock(&stateLock);
+    if (usernameExists(username)) {
+        pthread_rwlock_unlock(&stateLock);
+        printf("\n[!] Username already exists. Try logging in.\n");
+        waitForEnter();
+        return;
+    }
+    int sIndex = addStudent(username);
+    Student *st = &students[sIndex];
+    memcpy(st->salt, salt, SALT_LENGTH);
+    memcpy(st->passwordHash, hash, HASH_LENGTH);
+    st->kdfIterations = iterations;
+    uint64_t seq = journalSignup(sIndex);
+    pthread_rwlock_unlock(&stateLock);
+    journalCommitOrWarn(seq);
+
+    printf("\nSignup successful! You can now login.\n");
+    waitForEnter();
+}
+
+int studentLogin() {
+    char username[50], password[PASSWORD_LENGTH];
+    clearInput();
+    printHeader("Student Login");
+    printf("Username: ");
+    fgets(username, sizeof(username), stdin);
+    username[strcspn(username, "\n")] = 0;
+
+    printf("Password: ");
+    getPassword(password, PASSWORD_LENGTH);
+
+    int sIndex = validateStudentLogin(username, password);
+    if (sIndex != -1) {
+        printf("\nLogin successful! Welcome, %s\n", username);
+        waitForEnter();
+        return sIndex;
+    } else {
+        printf("\n[!] Invalid credentials.\n");
+        waitForEnter();
+        return -1;
+    }
+}
+
+// --- Catalog storage ---
+static uint32_t hashString(const char *str) {
+    uint32_t h = 2166136261u;
+    while (*str) {
+        h ^= (unsigned char)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+const char *poolStr(const StringPool *pool, uint32_t off) {
+    return pool->data + off;
+}
+
+static void poolGrowSlots(StringPool *pool) {
+    size_t newCap = pool->slotCap ? pool->slotCap * 2 : 256;
+    uint32_t *slots = calloc(newCap, sizeof(uint32_t));
+    if (!slots) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < pool->slotCap; i++) {
+        uint32_t v = pool->slots[i];
+        if (!v) continue;
+        size_t j = hashString(pool->data + v - 1) & (newCap - 1);
+        while (slots[j]) j = (j + 1) & (newCap - 1);
+        slots[j] = v;
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slotCap = newCap;
+}
+
+int poolFind(const StringPool *pool, const char *str, uint32_t *off) {
+    if (!pool->slotCap) return 0;
+    size_t j = hashString(str) & (pool->slotCap - 1);
+    while (pool->slots[j]) {
+        if (strcmp(pool->data + pool->slots[j] - 1, str) == 0) {
+            if (off) *off = pool->slots[j] - 1;
+            return 1;
+        }
+        j = (j + 1) & (pool->slotCap - 1);
+    }
+    return 0;
+}
+
+uint32_t poolIntern(StringPool *pool, const char *str) {
+    uint32_t off;
+    if (poolFind(pool, str, &off)) return off;
+
+    size_t len = strlen(str) + 1;
+    if (pool->size + len > pool->cap) {
+        size_t newCap = pool->cap ? pool->cap : 4096;
+        while (pool->size + len > newCap) newCap *= 2;
+        pool->data = xrealloc(pool->data, newCap);
+        pool->cap = newCap;
+    }
+    off = (uint32_t)pool->size;
+    memcpy(pool->data + off, str, len);
+    pool->size += len;
+
+    if ((pool->count + 1) * 4 > pool->slotCap * 3) poolGrowSlots(pool);
+    size_t j = hashString(str) & (pool->slotCap - 1);
+    while (pool->slots[j]) j = (j + 1) & (pool->slotCap - 1);
+    pool->slots[j] = off + 1;
+    pool->count++;
+    return off;
+}
+
+const char *streamName(int streamId) {
+    return poolStr(&lib.strings, lib.streams[streamId].nameOff);
+}
+
+const char *subjectName(int subjectId) {
+    return poolStr(&lib.strings, lib.subjects[subjectId].nameOff);
+}
+
+const char *bookName(int id) {
+    return poolStr(&lib.strings, lib.bookName[id]);
+}
+
+int catalogAddStream(const char *name) {
+    uint32_t off = poolIntern(&lib.strings, name);
+    for (int i = 0; i < lib.streamCount; i++) {
+        if (lib.streams[i].nameOff == off) return i;
+    }
+    if (lib.streamCount == lib.streamCap) {
+        lib.streamCap = lib.streamCap ? lib.streamCap * 2 : 8;
+        lib.streams = xrealloc(lib.streams, sizeof(Stream) * (size_t)lib.streamCap);
+    }
+    Stream *st = &lib.streams[lib.streamCount];
+    memset(st, 0, sizeof(*st));
+    st->nameOff = off;
+    return lib.streamCount++;
+}
+
+int catalogAddSubject(int streamId, const char *name) {
+    uint32_t off = poolIntern(&lib.strings, name);
+    Stream *st = &lib.streams[streamId];
+    for (int j = 0; j < st->subjectCount; j++) {
+        if (lib.subjects[st->subjectIds[j]].nameOff == off) return st->subjectIds[j];
+    }
+    if (lib.subjectCount == lib.subjectCap) {
+        lib.subjectCap = lib.subjectCap ? lib.subjectCap * 2 : 16;
+        lib.subjects = xrealloc(lib.subjects, sizeof(Subject) * (size_t)lib.subjectCap);
+    }
+    int id = lib.subjectCount++;
+    Subject *sub = &lib.subjects[id];
+    memset(sub, 0, sizeof(*sub));
+    sub->nameOff = off;
+    sub->streamId = streamId;
+
+    if (st->subjectCount == st->subjectCap) {
+        int newCap = st->subjectCap ? st->subjectCap * 2 : 4;
+        st->subjectIds = arenaGrow(&catalogArena, st->subjectIds, sizeof(int) * (size_t)st->subjectCap,
+                                   sizeof(int) * (size_t)newCap);
+        st->subjectCap = newCap;
+    }
+    st->subjectIds[st->subjectCount++] = id;
+    return id;
+}
+
+static void catalogGrowTitleSlots() {
+    int newCap = lib.titleSlotCap ? lib.titleSlotCap * 2 : 256;
+    int *slots = calloc((size_t)newCap, sizeof(int));
+    if (!slots) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < lib.titleSlotCap; i++) {
+        int v = lib.titleSlots[i];
+        if (!v) continue;
+        int j = (int)(hashString(bookName(v - 1)) & (uint32_t)(newCap - 1));
+        while (slots[j]) j = (j + 1) & (newCap - 1);
+        slots[j] = v;
+    }
+    free(lib.titleSlots);
+    lib.titleSlots = slots;
+    lib.titleSlotCap = newCap;
+}
+
+static void catalogBindId(int id, uint32_t bookId) {
+    if (bookId >= lib.rowByIdCap) {
+        uint32_t newCap = lib.rowByIdCap ? lib.rowByIdCap : 256;
+        while (newCap <= bookId) newCap *= 2;
+        lib.rowById = xrealloc(lib.rowById, sizeof(int) * newCap);
+        memset(lib.rowById + lib.rowByIdCap, 0, sizeof(int) * (newCap - lib.rowByIdCap));
+        lib.rowByIdCap = newCap;
+    }
+    lib.rowById[bookId] = id + 1;
+    lib.bookId[id] = bookId;
+    if (bookId >= lib.nextBookId) lib.nextBookId = bookId + 1;
+}
+
+// Adds a book with the given stable id, or none yet if bookId is 0 (see
+// catalogAssignIds). Returns its catalog row, or -1 if the id is taken.
+int catalogAddBook(int subjectId, const char *name, int quantity, uint32_t bookId) {
+    if (bookId && catalogRowById(bookId) >= 0) return -1;
+    if (lib.bookCount == lib.bookCap) {
+        lib.bookCap = lib.bookCap ? lib.bookCap * 2 : 64;
+        lib.bookName = xrealloc(lib.bookName, sizeof(uint32_t) * (size_t)lib.bookCap);
+        lib.bookSubject = xrealloc(lib.bookSubject, sizeof(int) * (size_t)lib.bookCap);
+        lib.quantity = xrealloc(lib.quantity, sizeof(int) * (size_t)lib.bookCap);
+        lib.bookId = xrealloc(lib.bookId, sizeof(uint32_t) * (size_t)lib.bookCap);
+    }
+    browseMarkLayout();
+    int id = lib.bookCount++;
+    lib.bookName[id] = poolIntern(&lib.strings, name);
+    lib.bookSubject[id] = subjectId;
+    lib.quantity[id] = quantity;
+    lib.bookId[id] = 0;
+    if (bookId) catalogBindId(id, bookId);
+
+    Subject *sub = &lib.subjects[subjectId];
+    if (sub->bookCount == sub->bookCap) {
+        int newCap = sub->bookCap ? sub->bookCap * 2 : 4;
+        sub->bookIds = arenaGrow(&catalogArena, sub->bookIds, sizeof(int) * (size_t)sub->bookCap,
+                                 sizeof(int) * (size_t)newCap);
+        sub->bookCap = newCap;
+    }
+    sub->bookIds[sub->bookCount++] = id;
+    if (!searchIndexDeferred()) indexAddBook(id);
+    holdReserve(id);
+
+    // A title listed under several subjects resolves to its first entry.
+    if (catalogFindBook(name) < 0) {
+        if ((lib.bookCount + 1) * 4 > lib.titleSlotCap * 3) catalogGrowTitleSlots();
+        int j = (int)(hashString(name) & (uint32_t)(lib.titleSlotCap - 1));
+        while (lib.titleSlots[j]) j = (j + 1) & (lib.titleSlotCap - 1);
+        lib.titleSlots[j] = id + 1;
+    }
+    return id;
+}
+
+// Gives every row added without an id the next free one, in row order, so a
+// catalog file without ids numbers its books 1, 2, 3... Returns the number
+// of ids assigned.
+int catalogAssignIds() {
+    int assigned = 0;
+    if (!lib.nextBookId) lib.nextBookId = 1;
+    for (int id = 0; id < lib.bookCount; id++) {
+        if (lib.bookId[id]) continue;
+        catalogBindId(id, lib.nextBookId);
+        assigned++;
+    }
+    return assigned;
+}
+
+int catalogRowById(uint32_t bookId) {
+    if (bookId == 0 || bookId >= lib.rowByIdCap) return -1;
+    return lib.rowById[bookId] - 1;
+}
+
+// Loans and log entries keep only the id; this is their title on display.
+const char *bookNameById(uint32_t bookId) {
+    int id = catalogRowById(bookId);
+    return id >= 0 ? bookName(id) : "(unknown book)";
+}
+
+// Resolve a (stream, subject, book) position as shown in the menus to a catalog row.
+int catalogBookAt(int s, int sub, int b) {
+    if (s < 0 || s >= lib.streamCount) return -1;
+    if (sub < 0 || sub >= lib.streams[s].subjectCount) return -1;
+    Subject *subject = &lib.subjects[lib.streams[s].subjectIds[sub]];
+    if (b < 0 || b >= subject->bookCount) return -1;
+    return subject->bookIds[b];
+}
+
+int catalogFindBook(const char *name) {
+    if (!lib.titleSlotCap) return -1;
+    int j = (int)(hashString(name) & (uint32_t)(lib.titleSlotCap - 1));
+    while (lib.titleSlots[j]) {
+        int id = lib.titleSlots[j] - 1;
+        if (strcmp(bookName(id), name) == 0) return id;
+        j = (j + 1) & (lib.titleSlotCap - 1);
+    }
+    return -1;
+}
+
+// --- Search index ---
+#define TOKEN_LENGTH 64
+
+// Copies the next run of letters/digits from *text into token, lower-cased.
+// Returns the token length, or 0 once the text is exhausted.
+int nextToken(const char **text, char *token, int maxLength) {
+    const unsigned char *p = (const unsigned char *)*text;
+    while (*p && !isalnum(*p)) p++;
+    int len = 0;
+    while (*p && isalnum(*p)) {
+        if (len < maxLength - 1) token[len++] = (char)tolower(*p);
+        p++;
+    }
+    token[len] = '\0';
+    *text = (const char *)p;
+    return len;
+}
+
+static int indexFindTerm(const char *term) {
+    if (!searchIdx.slotCap) return -1;
+    int j = (int)(hashString(term) & (uint32_t)(searchIdx.slotCap - 1));
+    while (searchIdx.slots[j]) {
+        int id = searchIdx.slots[j] - 1;
+        if (strcmp(poolStr(&searchIdx.terms, searchIdx.lists[id].termOff), term) == 0)
+            return id;
+        j = (j + 1) & (searchIdx.slotCap - 1);
+    }
+    return -1;
+}
+
+static void indexGrowSlots() {
+    int newCap = searchIdx.slotCap ? searchIdx.slotCap * 2 : 1024;
+    int *slots = calloc((size_t)newCap, sizeof(int));
+    if (!slots) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
+    }
+    for (int t = 0; t < searchIdx.termCount; t++) {
+        const char *term = poolStr(&searchIdx.terms, searchIdx.lists[t].termOff);
+        int j = (int)(hashString(term) & (uint32_t)(newCap - 1));
+        while (slots[j]) j = (j + 1) & (newCap - 1);
+        slots[j] = t + 1;
+    }
+    free(searchIdx.slots);
+    searchIdx.slots = slots;
+    searchIdx.slotCap = newCap;
+}
+
+static uint32_t trigramKey(const char *padded) {
+    return (uint32_t)(unsigned char)padded[0] << 16 | (uint32_t)(unsigned char)padded[1] << 8 |
+           (uint32_t)(unsigned char)padded[2];
+}
+
+static int trigramSlot(uint32_t key, int cap) {
+    return (int)((key * 2654435761u) >> 8) & (cap - 1);
+}
+
+static int indexFindTrigram(uint32_t key) {
+    if (!searchIdx.gramSlotCap) return -1;
+    int j = trigramSlot(key, searchIdx.gramSlotCap);
+    while (searchIdx.gramSlots[j]) {
+        int id = searchIdx.gramSlots[j] - 1;
+        if (searchIdx.grams[id].key == key) return id;
+        j = (j + 1) & (searchIdx.gramSlotCap - 1);
+    }
+    return -1;
+}
+
+static void indexGrowTrigramSlots() {
+    int newCap = searchIdx.gramSlotCap ? searchIdx.gramSlotCap * 2 : 4096;
+    int *slots = calloc((size_t)newCap, sizeof(int));
+    if (!slots) {
+        fprintf(stderr, "[!] Out of memory\n");
+        exit(1);
+    }
+    for (int g = 0; g < searchIdx.gramCount; g++) {
+        int j = trigramSlot(searchIdx.grams[g].key, newCap);
+        while (slots[j]) j = (j + 1) & (newCap - 1);
+        slots[j] = g + 1;
+    }
+    free(searchIdx.gramSlots);
+    searchIdx.gramSlots = slots;
+    searchIdx.gramSlotCap = newCap;
+}
+
+// Writes "^token$" with the markers as bytes 1 and 2, which never occur in a
+// token. Returns the number of trigrams, which equals the token length.
+static int trigramPad(const char *token, char *padded) {
+    int len = (int)strlen(token);
+    padded[0] = 1;
+    memcpy(padded + 1, token, (size_t)len);
+    padded[len + 1] = 2;
+    return len;
+}
+
+static void indexAddTrigrams(const char *term, int termId) {
+    char padded[TOKEN_LENGTH + 2];
+    int n = trigramPad(term, padded);
+    for (int i = 0; i < n; i++) {
+        uint32_t key = trigramKey(padded + i);
+        int g = indexFindTrigram(key);
+        if (g < 0) {
+            if ((searchIdx.gramCount + 1) * 4 > searchIdx.gramSlotCap * 3) indexGrowTrigramSlots();
+            if (searchIdx.gramCount == searchIdx.gramCap) {
+                searchIdx.gramCap = searchIdx.gramCap ? searchIdx.gramCap * 2 : 1024;
+                searchIdx.grams = xrealloc(searchIdx.grams, sizeof(TrigramList) * (size_t)searchIdx.gramCap);
+            }
+            g = searchIdx.gramCount++;
+            memset(&searchIdx.grams[g], 0, sizeof(TrigramList));
+            searchIdx.grams[g].key = key;
+            int j = trigramSlot(key, searchIdx.gramSlotCap);
+            while (searchIdx.gramSlots[j]) j = (j + 1) & (searchIdx.gramSlotCap - 1);
+            searchIdx.gramSlots[j] = g + 1;
+        }
+        TrigramList *gl = &searchIdx.grams[g];
+        if (gl->count && gl->terms[gl->count - 1] == termId) continue;   // repeated within the term
+        if (gl->count == gl->cap) {
+            int newCap = gl->cap ? gl->cap * 2 : 4;
+            gl->terms = arenaGrow(&catalogArena, gl->terms, sizeof(int) * (size_t)gl->cap,
+                                  sizeof(int) * (size_t)newCap);
+            gl->cap = newCap;
+        }
+        gl->terms[gl->count++] = termId;
+    }
+}
+
+static void indexAddPosting(const char *term, int bookId) {
+    int t = indexFindTerm(term);
+    if (t < 0) {
+        if ((searchIdx.termCount + 1) * 4 > searchIdx.slotCap * 3) indexGrowSlots();
+        if (searchIdx.termCount == searchIdx.termCap) {
+            searchIdx.termCap = searchIdx.termCap ? searchIdx.termCap * 2 : 256;
+            searchIdx.lists = xrealloc(searchIdx.lists, sizeof(PostingList) * (size_t)searchIdx.termCap);
+        }
+        t = searchIdx.termCount++;
+        memset(&searchIdx.lists[t], 0, sizeof(PostingList));
+        searchIdx.lists[t].termOff = poolIntern(&searchIdx.terms, term);
+        int j = (int)(hashString(term) & (uint32_t)(searchIdx.slotCap - 1));
+        while (searchIdx.slots[j]) j = (j + 1) & (searchIdx.slotCap - 1);
+        searchIdx.slots[j] = t + 1;
+        indexAddTrigrams(term, t);
+    }
+
+    PostingList *pl = &searchIdx.lists[t];
+    // Books are indexed in id order, so a repeated term only needs checking
+    // against the tail.
+    if (pl->count && pl->postings[pl->count - 1] == bookId) return;
+    if (pl->count == pl->cap) {
+        int newCap = pl->cap ? pl->cap * 2 : 4;
+        pl->postings = arenaGrow(&catalogArena, pl->postings, sizeof(int) * (size_t)pl->cap,
+                                 sizeof(int) * (size_t)newCap);
+        pl->cap = newCap;
+    }
+    pl->postings[pl->count++] = bookId;
+}
+
+static void indexAddText(const char *text, int bookId) {
+    char token[TOKEN_LENGTH];
+    while (nextToken(&text, token, TOKEN_LENGTH))
+        indexAddPosting(token, bookId);
+}
+
+void indexAddBook(int bookId) {
+    int sub = lib.bookSubject[bookId];
+    indexAddText(bookName(bookId), bookId);
+    indexAddText(subjectName(sub), bookId);
+    indexAddText(streamName(lib.subjects[sub].streamId), bookId);
+}
+
+static int compareTermIds(const void *a, const void *b) {
+    return strcmp(poolStr(&searchIdx.terms, searchIdx.lists[*(const int *)a].termOff),
+                  poolStr(&searchIdx.terms, searchIdx.lists[*(const int *)b].termOff));
+}
+
+static int compareInts(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// The sorted term table is only rebuilt when new terms were added since the
+// last prefix lookup.
+static void indexSortTerms() {
+    if (searchIdx.sortedCount == searchIdx.termCount) return;
+    searchIdx.sorted = xrealloc(searchIdx.sorted, sizeof(int) * (size_t)(searchIdx.termCount + 1));
+    for (int t = 0; t < searchIdx.termCount; t++) searchIdx.sorted[t] = t;
+    qsort(searchIdx.sorted, (size_t)searchIdx.termCount, sizeof(int), compareTermIds);
+    searchIdx.sortedCount = searchIdx.termCount;
+}
+
+// At startup books.csv is read without indexing it, and a background task
+// indexes the whole catalog once it is in; searches wait for that. Catalog
+// changes take the write side of stateLock, so while the build holds the
+// read side none can slip in, and any made before it started are included.
+static int searchIndexPending = 0;
+static pthread_mutex_t searchIndexLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t searchIndexBuilt = PTHREAD_COND_INITIALIZER;
+
+void searchIndexDefer() {
+    __atomic_store_n(&searchIndexPending, 1, __ATOMIC_RELEASE);
+}
+
+int searchIndexDeferred() {
+    return __atomic_load_n(&searchIndexPending, __ATOMIC_ACQUIRE);
+}
+
+void searchIndexBuild() {
+    uint64_t start = metricStart();
+    pthread_rwlock_rdlock(&stateLock);
+    for (int id = 0; id < lib.bookCount; id++) indexAddBook(id);
+    indexSortTerms();
+    pthread_mutex_lock(&searchIndexLock);
+    __atomic_store_n(&searchIndexPending, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&searchIndexBuilt);
+    pthread_mutex_unlock(&searchIndexLock);
+    pthread_rwlock_unlock(&stateLock);
+    metricEnd(METRIC_BUILD_INDEX, start, 1);
+}
+
+static void searchIndexAwait() {
+    if (!searchIndexDeferred()) return;
+    pthread_mutex_lock(&searchIndexLock);
+    while (searchIndexPending) pthread_cond_wait(&searchIndexBuilt, &searchIndexLock);
+    pthread_mutex_unlock(&searchIndexLock);
+}
+
+// Collects the ascending, de-duplicated ids of books with a token starting
+// with prefix. Returns the count and stores an array from 'arena' in *out.
+static int indexPrefixPostings(Arena *arena, const char *prefix, int **out) {
+    indexSortTerms();
+    size_t plen = strlen(prefix);
+    int lo = 0, hi = searchIdx.sortedCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(poolStr(&searchIdx.terms, searchIdx.lists[searchIdx.sorted[mid]].termOff), prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    int total = 0, lists = 0;
+    for (int i = lo; i < searchIdx.sortedCount; i++) {
+        PostingList *pl = &searchIdx.lists[searchIdx.sorted[i]];
+        if (strncmp(poolStr(&searchIdx.terms, pl->termOff), prefix, plen) != 0) break;
+        total += pl->count;
+        lists++;
+    }
+
+    int *ids = arenaAlloc(arena, sizeof(int) * (size_t)(total + 1));
+    int n = 0;
+    for (int i = lo; i < lo + lists; i++) {
+        PostingList *pl = &searchIdx.lists[searchIdx.sorted[i]];
+        memcpy(ids + n, pl->postings, sizeof(int) * (size_t)pl->count);
+        n += pl->count;
+    }
+    if (lists > 1) {
+        qsort(ids, (size_t)n, sizeof(int), compareInts);
+        int u = 0;
+        for (int i = 0; i < n; i++) {
+            if (u == 0 || ids[u - 1] != ids[i]) ids[u++] = ids[i];
+        }
+        n = u;
+    }
+    *out = ids;
+    return n;
+}
+
+// Runs an AND query where every term matches as a token prefix. Returns the
+// number of matching books and stores their ascending ids in *results, which
+// are allocated from 'arena' along with the working lists. An empty query
+// matches every book.
+int searchIndexQuery(Arena *arena, const char *query, int **results) {
+    searchIndexAwait();
+    uint64_t start = metricStart();
+    char token[TOKEN_LENGTH];
+    const char *p = query;
+    int *acc = NULL;
+    int accCount = -1;
+
+    while (accCount != 0 && nextToken(&p, token, TOKEN_LENGTH)) {
+        int *ids;
+        int n = indexPrefixPostings(arena, token, &ids);
+        if (accCount < 0) {
+            acc = ids;
+            accCount = n;
+            continue;
+        }
+        int k = 0, i = 0, j = 0;
+        while (i < accCount && j < n) {
+            if (acc[i] < ids[j]) i++;
+            else if (acc[i] > ids[j]) j++;
+            else { acc[k++] = acc[i]; i++; j++; }
+        }
+        accCount = k;
+    }
+
+    if (accCount < 0) {
+        acc = arenaAlloc(arena, sizeof(int) * (size_t)(lib.bookCount + 1));
+        for (int id = 0; id < lib.bookCount; id++) acc[id] = id;
+        accCount = lib.bookCount;
+    }
+    *results = acc;
+    metricEnd(METRIC_SEARCH, start, 1);
+    return accCount;
+}
+
+// Typos allowed in a word of the given length.
+static int fuzzyMaxDistance(int len) {
+    return len <= 2 ? 0 : len <= 5 ? 1 : len <= 9 ? 2 : 3;
+}
+
+// Levenshtein distance between the pattern described by peq (m <= 64
+// characters) and text, computed a column at a time with Myers' bit-vector
+// algorithm (Hyyro's formulation). Gives up with limit + 1 as soon as the
+// distance must exceed limit.
+static int fuzzyDistance(const uint64_t *peq, int m, const char *text, int n, int limit) {
+    uint64_t pv = ~0ull, mv = 0, high = 1ull << (m - 1);
+    int score = m;
+    for (int j = 0; j < n; j++) {
+        uint64_t eq = peq[(unsigned char)text[j]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & high) score++;
+        else if (mh & high) score--;
+        ph = ph << 1 | 1;       // row 0 of the matrix is 0, 1, 2, ...
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (score - (n - 1 - j) > limit) return limit + 1;
+    }
+    return score;
+}
+
+typedef struct {
+    int term;
+    int distance;
+} FuzzyTerm;
+
+static int compareFuzzyTerms(const void *a, const void *b) {
+    return ((const FuzzyTerm *)a)->distance - ((const FuzzyTerm *)b)->distance;
+}
+
+// Terms within fuzzyMaxDistance of token, found by counting shared trigrams
+// (k edits destroy at most 3k of a word's trigrams) and then checking the
+// survivors' edit distance. shared is a zeroed scratch array with a slot per
+// term and is left zeroed.
+static int fuzzyTerms(Arena *arena, const char *token, int *shared, FuzzyTerm **out) {
+    int m = (int)strlen(token), limit = fuzzyMaxDistance(m);
+    FuzzyTerm *found;
+    if (limit == 0) {
+        int t = indexFindTerm(token);
+        found = arenaAlloc(arena, sizeof(FuzzyTerm));
+        found->term = t;
+        found->distance = 0;
+        *out = found;
+        return t >= 0;
+    }
+
+    char padded[TOKEN_LENGTH + 2];
+    int grams = trigramPad(token, padded);
+    int *touched = NULL, touchedCount = 0, touchedCap = 0;
+    for (int i = 0; i < grams; i++) {
+        int g = indexFindTrigram(trigramKey(padded + i));
+        if (g < 0) continue;
+        const TrigramList *gl = &searchIdx.grams[g];
+        if (touchedCount + gl->count > touchedCap) {
+            int newCap = (touchedCount + gl->count) * 2;
+            touched = arenaGrow(arena, touched, sizeof(int) * (size_t)touchedCap, sizeof(int) * (size_t)newCap);
+            touchedCap = newCap;
+        }
+        for (int k = 0; k < gl->count; k++) {
+            if (shared[gl->terms[k]]++ == 0) touched[touchedCount++] = gl->terms[k];
+        }
+    }
+
+    // Short words may share no trigram with a one-typo variant; they still
+    // need one so a lookup never degrades into a scan of every term.
+    int need = grams - 3 * limit > 1 ? grams - 3 * limit : 1;
+    uint64_t peq[256] = {0};
+    for (int i = 0; i < m; i++) peq[(unsigned char)token[i]] |= 1ull << i;
+    found = arenaAlloc(arena, sizeof(FuzzyTerm) * (size_t)(touchedCount + 1));
+    int count = 0;
+    for (int k = 0; k < touchedCount; k++) {
+        int t = touched[k];
+        int common = shared[t];
+        shared[t] = 0;
+        if (common < need) continue;
+        const char *term = poolStr(&searchIdx.terms, searchIdx.lists[t].termOff);
+        int n = (int)strlen(term);
+        if (n < m - limit || n > m + limit) continue;
+        int d = fuzzyDistance(peq, m, term, n, limit);
+        if (d <= limit) {
+            found[count].term = t;
+            found[count].distance = d;
+            count++;
+        }
+    }
+    qsort(found, (size_t)count, sizeof(FuzzyTerm), compareFuzzyTerms);
+    *out = found;
+    return count;
+}
+
+// Better hits first: more query words matched, fewer typos, shorter title.
+static int fuzzyBetter(const FuzzyHit *a, const FuzzyHit *b) {
+    if (a->matched != b->matched) return a->matched > b->matched;
+    if (a->distance != b->distance) return a->distance < b->distance;
+    size_t la = strlen(bookName(a->id)), lb = strlen(bookName(b->id));
+    if (la != lb) return la < lb;
+    return a->id < b->id;
+}
+
+// Ranks books by how closely their title, subject and stream words match the
+// query words, allowing a few typos per word. Stores up to limit hits, best
+// first, in an array from 'arena' and returns their number.
+int searchIndexFuzzy(Arena *arena, const char *query, int limit, FuzzyHit **hits) {
+    searchIndexAwait();
+    uint64_t start = metricStart();
+    if (limit < 1) limit = 1;
+    int *shared = arenaAlloc(arena, sizeof(int) * (size_t)(searchIdx.termCount + 1));
+    memset(shared, 0, sizeof(int) * (size_t)searchIdx.termCount);
+    unsigned char *words = arenaAlloc(arena, (size_t)lib.bookCount + 1);   // bit per query word matched
+    memset(words, 0, (size_t)lib.bookCount);
+    int *distance = arenaAlloc(arena, sizeof(int) * (size_t)(lib.bookCount + 1));
+    int *books = arenaAlloc(arena, sizeof(int) * (size_t)(lib.bookCount + 1));
+    int bookCount = 0;
+
+    char token[TOKEN_LENGTH];
+    const char *p = query;
+    for (int w = 0; w < FUZZY_MAX_WORDS && nextToken(&p, token, TOKEN_LENGTH); w++) {
+        FuzzyTerm *terms;
+        int n = fuzzyTerms(arena, token, shared, &terms);
+        // Terms come closest first, so a book's first match for this word
+        // is its best.
+        for (int i = 0; i < n; i++) {
+            const PostingList *pl = &searchIdx.lists[terms[i].term];
+            for (int k = 0; k < pl->count; k++) {
+                int b = pl->postings[k];
+                if (words[b] & (1u << w)) continue;
+                if (!words[b]) {
+                    books[bookCount++] = b;
+                    distance[b] = 0;
+                }
+                words[b] |= (unsigned char)(1u << w);
+                distance[b] += terms[i].distance;
+            }
+        }
+    }
+
+    // Keep the best 'limit' in order by insertion; limit is small.
+    FuzzyHit *top = arenaAlloc(arena, sizeof(FuzzyHit) * (size_t)(limit + 1));
+    int count = 0;
+    for (int i = 0; i < bookCount; i++) {
+        FuzzyHit h = { books[i], __builtin_popcount(words[books[i]]), distance[books[i]] };
+        if (count == limit && !fuzzyBetter(&h, &top[count - 1])) continue;
+        int j = count < limit ? count++ : count - 1;
+        while (j > 0 && fuzzyBetter(&h, &top[j - 1])) {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = h;
+    }
+    *hits = top;
+    metricEnd(METRIC_FUZZY, start, 1);
+    return count;
+}
+
+// --- Catalog file loading ---
+// Splits one CSV line in place. Fields may be wrapped in double quotes, with
+// "" standing for a literal quote. Returns the number of fields found, or -1
+// on an unterminated quote.
+int parseCatalogLine(char *line, char **fields, int maxFields) {
+    int count = 0;
+    char *p = line;
+    while (count < maxFields) {
+        while (*p == ' ' || *p == '\t') p++;
+        char *out = p;
+        fields[count++] = p;
+        if (*p == '"') {
+            p++;
+            while (1) {
+                if (!*p) return -1;
+                if (*p == '"') {
+                    if (p[1] != '"') break;
+                    p++;
+                }
+                *out++ = *p++;
+            }
+            p++;
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p && *p != ',') return -1;
+        } else {
+            while (*p && *p != ',') *out++ = *p++;
+            while (out > fields[count - 1] && (out[-1] == ' ' || out[-1] == '\t')) out--;
+        }
+        if (!*p) {
+            *out = '\0';
+            return count;
+        }
+        *out = '\0';
+        p++;
+    }
+    return count + 1;   // too many fields
+}
+
+static int parseHex4(const char *p, unsigned *out) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = tolower((unsigned char)p[i]);
+        if (c >= '0' && c <= '9') v = v * 16 + (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') v = v * 16 + (unsigned)(c - 'a' + 10);
+        else return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+// Decodes the JSON string starting at the opening quote in place. Returns the
+// position after the closing quote, or NULL if the string is malformed.
+static char *parseJsonString(char *p, char **out) {
+    char *w = ++p;
+    *out = w;
+    while (*p != '"') {
+        if (!*p) return NULL;
+        if (*p != '\\') {
+            *w++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p++) {
+            case '"': *w++ = '"'; break;
+            case '\\': *w++ = '\\'; break;
+            case '/': *w++ = '/'; break;
+            case 'b': *w++ = '\b'; break;
+            case 'f': *w++ = '\f'; break;
+            case 'n': *w++ = '\n'; break;
+            case 'r': *w++ = '\r'; break;
+            case 't': *w++ = '\t'; break;
+            case 'u': {
+                unsigned cp, lo;
+                if (parseHex4(p, &cp) < 0) return NULL;
+                p += 4;
+                if (cp >= 0xd800 && cp < 0xdc00 && p[0] == '\\' && p[1] == 'u' &&
+                    parseHex4(p + 2, &lo) == 0 && lo >= 0xdc00 && lo < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    p += 6;
+                }
+                // The escape is at least as long as its UTF-8 encoding.
+                if (cp < 0x80) {
+                    *w++ = (char)cp;
+                } else if (cp < 0x800) {
+                    *w++ = (char)(0xc0 | cp >> 6);
+                    *w++ = (char)(0x80 | (cp & 0x3f));
+                } else if (cp < 0x10000) {
+                    *w++ = (char)(0xe0 | cp >> 12);
+                    *w++ = (char)(0x80 | (cp >> 6 & 0x3f));
+                    *w++ = (char)(0x80 | (cp & 0x3f));
+                } else {
+                    *w++ = (char)(0xf0 | cp >> 18);
+                    *w++ = (char)(0x80 | (cp >> 12 & 0x3f));
+                    *w++ = (char)(0x80 | (cp >> 6 & 0x3f));
+                    *w++ = (char)(0x80 | (cp & 0x3f));
+                }
+                break;
+            }
+            default: return NULL;
+        }
+    }
+    *w = '\0';
+    return p + 1;
+}
+
+// Picks stream, subject, title, quantity and the optional id out of a flat
+// JSON object, in place. Other keys are ignored. Returns the number of
+// fields, or -1 if a required one is missing.
+static int parseCatalogJson(char *line, char **fields) {
+    static const char *keys[5] = { "stream", "subject", "title", "quantity", "id" };
+    char *p = line + 1;
+    for (int i = 0; i < 5; i++) fields[i] = NULL;
+    while (1) {
+        char *key, *value;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p != '"' || !(p = parseJsonString(p, &key))) return -1;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p++ != ':') return -1;
+        while (isspace((unsigned char)*p)) p++;
+        char delim;
+        if (*p == '"') {
+            if (!(p = parseJsonString(p, &value))) return -1;
+            while (isspace((unsigned char)*p)) p++;
+            delim = *p;
+        } else if (*p == '{' || *p == '[') {
+            return -1;
+        } else {
+            value = p;
+            while (*p && *p != ',' && *p != '}' && !isspace((unsigned char)*p)) p++;
+            char *end = p;
+            while (isspace((unsigned char)*p)) p++;
+            delim = *p;
+            *end = '\0';
+        }
+        for (int i = 0; i < 5; i++) {
+            if (strcmp(key, keys[i]) == 0) fields[i] = value;
+        }
+        if (delim == '}') break;
+        if (delim != ',') return -1;
+        p++;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (!fields[i]) return -1;
+    }
+    return fields[4] ? 5 : 4;
+}
+
+// Validates one catalog line, either CSV or a JSON object (JSONL). Returns 1
+// with fields, quantity and book id (0 if the line has none) filled in, 0 for
+// a blank, comment or header line, and -1 after reporting an invalid line.
+static int parseCatalogRow(char *line, int lineNo, const char *path, char **fields,
+                           int *quantity, uint32_t *bookId) {
+    line[strcspn(line, "\r")] = '\0';
+    char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (!*p || *p == '#') return 0;
+
+    int n;
+    if (*p == '{') {
+        n = parseCatalogJson(p, fields);
+        if (n < 0) {
+            fprintf(stderr, "[!] %s:%d: expected a JSON object with stream, subject, title and quantity\n", path, lineNo);
+            return -1;
+        }
+    } else {
+        n = parseCatalogLine(line, fields, 5);
+        if (n != 4 && n != 5) {
+            fprintf(stderr, "[!] %s:%d: expected stream,subject,title,quantity[,id]\n", path, lineNo);
+            return -1;
+        }
+        if (lineNo == 1 && strcasecmp(fields[0], "stream") == 0) return 0;   // header
+    }
+
+    for (int i = 0; i < 3; i++) {
+        size_t len = strlen(fields[i]);
+        if (len == 0 || len >= CATALOG_FIELD_LENGTH) {
+            fprintf(stderr, "[!] %s:%d: field %d is empty or longer than %d characters\n",
+                path, lineNo, i + 1, CATALOG_FIELD_LENGTH - 1);
+            return -1;
+        }
+        for (const unsigned char *c = (const unsigned char *)fields[i]; *c; c++) {
+            if (*c < 0x20) {
+                fprintf(stderr, "[!] %s:%d: field %d contains a control character\n", path, lineNo, i + 1);
+                return -1;
+            }
+        }
+    }
+    char *end;
+    long value = strtol(fields[3], &end, 10);
+    if (end == fields[3] || *end || value < 0 || value > 1000000) {
+        fprintf(stderr, "[!] %s:%d: invalid quantity '%s'\n", path, lineNo, fields[3]);
+        return -1;
+    }
+    *quantity = (int)value;
+    *bookId = 0;
+    if (n == 5 && fields[4][0]) {
+        value = strtol(fields[4], &end, 10);
+        if (end == fields[4] || *end || value < 1 || value > CATALOG_MAX_BOOK_ID) {
+            fprintf(stderr, "[!] %s:%d: invalid book id '%s'\n", path, lineNo, fields[4]);
+            return -1;
+        }
+        *bookId = (uint32_t)value;
+    }
+    return 1;
+}
+
+// Adds one validated row to the catalog. Returns its row, or -1 if the book
+// id is taken.
+static int addCatalogRow(char **fields, int quantity, uint32_t bookId) {
+    // Catalog files are usually grouped by stream and subject, so remember
+    // the last one instead of searching for it on every line.
+    static int lastStream = -1, lastSubject = -1;
+    static uint32_t lastStreamOff, lastSubjectOff;
+    uint32_t off;
+    if (lastStream < 0 || lastStream >= lib.streamCount ||
+        !poolFind(&lib.strings, fields[0], &off) || off != lastStreamOff) {
+        lastStream = catalogAddStream(fields[0]);
+        lastStreamOff = lib.streams[lastStream].nameOff;
+        lastSubject = -1;
+    }
+    if (lastSubject < 0 || lastSubject >= lib.subjectCount ||
+        !poolFind(&lib.strings, fields[1], &off) || off != lastSubjectOff) {
+        lastSubject = catalogAddSubject(lastStream, fields[1]);
+        lastSubjectOff = lib.subjects[lastSubject].nameOff;
+    }
+    return catalogAddBook(lastSubject, fields[2], quantity, bookId);
+}
+
+// ctx, if set, counts the rows that came without an id.
+static int loadCatalogRow(void *ctx, char **fields, int quantity, uint32_t bookId) {
+    if (addCatalogRow(fields, quantity, bookId) < 0) {
+        fprintf(stderr, "[!] Book id %u of '%s' is already used\n", bookId, fields[2]);
+        return -1;
+    }
+    if (!bookId && ctx) (*(int *)ctx)++;
+    return 1;
+}
+
+static int handleCatalogLine(char *line, int lineNo, const char *path,
+                             CatalogRowHandler handler, void *ctx) {
+    char *fields[5];
+    int quantity;
+    uint32_t bookId;
+    int r = parseCatalogRow(line, lineNo, path, fields, &quantity, &bookId);
+    return r > 0 ? handler(ctx, fields, quantity, bookId) : r;
+}
+
+// Reads a catalog file in fixed-size chunks and passes every valid row to
+// handler, which returns 1 if it took the row, 0 if it skipped it and -1 if
+// it rejected it. Returns
+// the number of rows taken, or -1 if the file cannot be opened. A path of "-"
+// reads stdin.
+int readCatalogFile(const char *path, CatalogRowHandler handler, void *ctx, int *errorCount) {
+    int isStdin = strcmp(path, "-") == 0;
+    FILE *fp = isStdin ? stdin : fopen(path, "rb");
+    if (!fp) return -1;
+
+    char *buf = xrealloc(NULL, CATALOG_READ_CHUNK + CATALOG_MAX_LINE + 1);
+    size_t carry = 0;
+    int lineNo = 0, loaded = 0, errors = 0, eof = 0;
+
+    while (!eof) {
+        size_t n = fread(buf + carry, 1, CATALOG_READ_CHUNK, fp);
+        if (n == 0) eof = 1;
+        metricIo(IO_CATALOG, n, 0);
+        size_t len = carry + n;
+        buf[len] = '\0';
+
+        char *line = buf;
+        char *nl;
+        while ((nl = memchr(line, '\n', len - (size_t)(line - buf))) != NULL) {
+            *nl = '\0';
+            int r = handleCatalogLine(line, ++lineNo, path, handler, ctx);
+            if (r > 0) loaded++;
+            else if (r < 0) errors++;
+            line = nl + 1;
+        }
+
+        carry = len - (size_t)(line - buf);
+        if (eof && carry) {
+            int r = handleCatalogLine(line, ++lineNo, path, handler, ctx);
+            if (r > 0) loaded++;
+            else if (r < 0) errors++;
+            carry = 0;
+        } else if (carry > CATALOG_MAX_LINE) {
+            fprintf(stderr, "[!] %s:%d: line longer than %d bytes\n", path, lineNo + 1, CATALOG_MAX_LINE);
+            errors++;
+            // Skip the rest of the oversized line.
+            int c;
+            while ((c = fgetc(fp)) != EOF && c != '\n');
+            if (c == EOF) eof = 1;
+            lineNo++;
+            carry = 0;
+        } else {
+            memmove(buf, line, carry);
+        }
+    }
+    free(buf);
+    if (!isStdin) fclose(fp);
+    if (errorCount) *errorCount = errors;
+    return loaded;
+}
+
+// Adds every valid line of a stream,subject,title,quantity[,id] file to the
+// catalog and numbers the books that have no id. Returns the number of books
+// loaded, or -1 if the file cannot be opened.
+int loadCatalogFile(const char *path, int *errorCount) {
+    int loaded = readCatalogFile(path, loadCatalogRow, NULL, errorCount);
+    catalogAssignIds();
+    return loaded;
+}
+
+// --- Catalog import/export ---
+// Imports merge rows into the live catalog and rewrite books.csv grouped by
+// stream and subject. Every row keeps its book id across the rewrite, so the
+// loans, logs and journal records that refer to it stay valid; new rows get
+// fresh ids. Titles are deduplicated on their normalized form, so
+// "Data  Structures in C" and "data structures in C" are the same book.
+typedef struct {
+    StringPool seen;        // normalized titles in the catalog and the batch
+    int added;
+    int duplicates;
+    int errors;
+    double seedMs, mergeMs, indexMs, writeMs;
+} CatalogImport;
+
+static void writeCsvField(FILE *fp, const char *text, char after) {
+    size_t len = strlen(text);
+    // Quote anything the catalog parser would otherwise split, trim or skip.
+    if (strpbrk(text, ",\"\n") || (len && (isspace((unsigned char)text[0]) ||
+        isspace((unsigned char)text[len - 1]) || text[0] == '#' || text[0] == '{'))) {
+        fputc('"', fp);
+        for (; *text; text++) {
+            if (*text == '"') fputc('"', fp);
+            fputc(*text, fp);
+        }
+        fputc('"', fp);
+    } else {
+        fputs(text, fp);
+    }
+    fputc(after, fp);
+}
+
+static void writeJsonString(FILE *fp, const char *text) {
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') fprintf(fp, "\\%c", *p);
+        else if (*p < 0x20) fprintf(fp, "\\u%04x", *p);
+        else fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+// Lower-cased words joined by single spaces; titles without any letters or
+// digits are kept as they are.
+static void normalizeTitle(const char *title, char *out, size_t size) {
+    const char *p = title;
+    char token[TOKEN_LENGTH];
+    size_t len = 0;
+    out[0] = '\0';
+    while (nextToken(&p, token, TOKEN_LENGTH)) {
+        size_t n = strlen(token);
+        if (len + n + 2 > size) break;
+        if (len) out[len++] = ' ';
+        memcpy(out + len, token, n + 1);
+        len += n;
+    }
+    if (!len) snprintf(out, size, "%s", title);
+}
+
+static void catalogImportBegin(CatalogImport *imp) {
+    double start = nowMs();
+    memset(imp, 0, sizeof(*imp));
+    char key[CATALOG_FIELD_LENGTH];
+    for (int id = 0; id < lib.bookCount; id++) {
+        normalizeTitle(bookName(id), key, sizeof(key));
+        poolIntern(&imp->seen, key);
+    }
+    imp->seedMs = nowMs() - start;
+}
+
+static void catalogImportEnd(CatalogImport *imp) {
+    free(imp->seen.data);
+    free(imp->seen.slots);
+    memset(&imp->seen, 0, sizeof(imp->seen));
+}
+
+// Ids in imported files belong to some other catalog, so new books are
+// numbered after the existing ones instead.
+static int importCatalogRow(void *ctx, char **fields, int quantity, uint32_t bookId) {
+    CatalogImport *imp = ctx;
+    (void)bookId;
+    char key[CATALOG_FIELD_LENGTH];
+    normalizeTitle(fields[2], key, sizeof(key));
+    if (poolFind(&imp->seen, key, NULL)) {
+        imp->duplicates++;
+        return 0;
+    }
+    poolIntern(&imp->seen, key);
+    addCatalogRow(fields, quantity, 0);
+    imp->added++;
+    return 1;
+}
+
+// books.csv records every copy the library owns; reconcileInventory takes the
+// ones out on loan or set aside for holds off the shelf at startup, so add
+// them back here.
+static int *catalogOwnedCopies() {
+    int *owned = xrealloc(NULL, sizeof(int) * (size_t)(lib.bookCount + 1));
+    for (int id = 0; id < lib.bookCount; id++) owned[id] = stockLevel(id);
+    for (int i = 0; i < studentCount; i++) {
+        for (int k = 0; k < students[i].activeCount; k++) {
+            int id = catalogRowById(students[i].loans[students[i].active[k]].bookId);
+            if (id >= 0) owned[id]++;
+        }
+        pthread_mutex_lock(&holdListLocks[i % STUDENT_LOCK_STRIPES]);
+        for (int k = 0; k < students[i].holdCount; k++) {
+            int id = catalogRowById(students[i].holds[k].bookId);
+            if (id >= 0 && students[i].holds[k].ready) owned[id]++;
+        }
+        pthread_mutex_unlock(&holdListLocks[i % STUDENT_LOCK_STRIPES]);
+    }
+    return owned;
+}
+
+// Streams the catalog to fp as CSV or JSONL, grouped by stream and subject.
+// Returns the number of rows written.
+int writeCatalog(FILE *fp, int jsonl) {
+    int *owned = catalogOwnedCopies();
+    int rows = 0;
+    if (!jsonl) fprintf(fp, "stream,subject,title,quantity,id\n");
+    for (int s = 0; s < lib.streamCount; s++) {
+        const char *stream = streamName(s);
+        for (int j = 0; j < lib.streams[s].subjectCount; j++) {
+            int subjectId = lib.streams[s].subjectIds[j];
+            const Subject *sub = &lib.subjects[subjectId];
+            for (int b = 0; b < sub->bookCount; b++, rows++) {
+                int id = sub->bookIds[b];
+                if (jsonl) {
+                    fputs("{\"stream\":", fp);
+                    writeJsonString(fp, stream);
+                    fputs(",\"subject\":", fp);
+                    writeJsonString(fp, subjectName(subjectId));
+                    fputs(",\"title\":", fp);
+                    writeJsonString(fp, bookName(id));
+                    fprintf(fp, ",\"quantity\":%d,\"id\":%u}\n", owned[id], lib.bookId[id]);
+                } else {
+                    writeCsvField(fp, stream, ',');
+                    writeCsvField(fp, subjectName(subjectId), ',');
+                    writeCsvField(fp, bookName(id), ',');
+                    fprintf(fp, "%d,%u\n", owned[id], lib.bookId[id]);
+                }
+            }
+        }
+    }
+    free(owned);
+    return rows;
+}
+
+// Writes the catalog to path through a temporary file, so readers see either
+// the old or the new file. Returns the row count, or -1 on error.
+int writeCatalogFile(const char *path, int jsonl) {
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *fp = fopen(tmpPath, "w");
+    if (!fp) return -1;
+    static char buffer[1 << 16];
+    setvbuf(fp, buffer, _IOFBF, sizeof(buffer));
+    int rows = writeCatalog(fp, jsonl);
+    int ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    long written = ftell(fp);
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+    metricIo(IO_CATALOG, 0, written > 0 ? (uint64_t)written : 0);
+    return rows;
+}
+
+// Merges a CSV or JSONL file ("-" for stdin) into the catalog and, unless
+// dryRun, saves books.csv. Returns -1 if the file cannot be read or saved.
+int importCatalog(const char *path, int dryRun, CatalogImport *imp) {
+    pthread_rwlock_wrlock(&stateLock);
+    catalogImportBegin(imp);
+    double start = nowMs();
+    int rc = readCatalogFile(path, importCatalogRow, imp, &imp->errors);
+    catalogAssignIds();
+    imp->mergeMs = nowMs() - start;
+    if (rc >= 0) {
+        start = nowMs();
+        indexSortTerms();
+        imp->indexMs = nowMs() - start;
+        start = nowMs();
+        if (!dryRun && imp->added > 0 && writeCatalogFile(CATALOG_FILE, 0) < 0) rc = -1;
+        imp->writeMs = nowMs() - start;
+    }
+    catalogImportEnd(imp);
+    pthread_rwlock_unlock(&stateLock);
+    return rc < 0 ? -1 : 0;
+}
+
+// Adds one book from the admin menu. Returns its id, -1 if a book with the
+// same normalized title exists, or -2 if the catalog could not be saved.
+int catalogAddTitle(char **fields, int quantity) {
+    CatalogImport imp;
+    pthread_rwlock_wrlock(&stateLock);
+    catalogImportBegin(&imp);
+    int id = importCatalogRow(&imp, fields, quantity, 0) ? lib.bookCount - 1 : -1;
+    catalogImportEnd(&imp);
+    catalogAssignIds();
+    if (id >= 0 && writeCatalogFile(CATALOG_FILE, 0) < 0) id = -2;
+    pthread_rwlock_unlock(&stateLock);
+    return id;
+}
+
+// --- Browse view ---
+// The browse screens print a pre-rendered copy of the catalog table. Issues
+// and returns only flag the book whose stock changed; the next reader patches
+// the quantity column of those rows (or renders everything again after books
+// or subjects are added). A reader holds a version until it has printed it,
+// so a version in use is never changed: patching it goes to a copy, and the
+// old version is freed by its last reader.
+struct BrowseView {
+    uint64_t version;           // stock changes folded in
+    uint64_t layout;            // catalog layout rendered
+    int refs;
+    int retired;                // superseded; freed when refs drops to 0
+    char *all;                  // rows of the Available Books table
+    size_t allLen;
+    char *bySubject;            // numbered rows of each subject's table
+    size_t bySubjectLen;
+    size_t *allRow;             // row start in all, by catalog row
+    size_t *subjectRow;         // row start in bySubject, by catalog row
+    size_t *subjectSpan;        // start and end in bySubject, by subject
+    int bookCount, subjectCount;
+};
+
+#define BROWSE_QTY_WIDTH 8      // "%8d |\n" ends every row
+
+static pthread_mutex_t browseLock = PTHREAD_MUTEX_INITIALIZER;
+static BrowseView *browseCurrent;
+static uint64_t browseStockVersion;     // bumped on every stock change
+static uint64_t browseLayout;           // bumped when rows are added; under the write side of stateLock
+static uint64_t *browseDirty;           // one bit per catalog row whose stock changed
+static size_t browseDirtyWords;
+
+// Called with the write side of stateLock held (or before any threads run).
+void browseMarkLayout() {
+    size_t words = ((size_t)lib.bookCap + 63) / 64;
+    if (words > browseDirtyWords) {
+        browseDirty = xrealloc(browseDirty, sizeof(uint64_t) * words);
+        memset(browseDirty + browseDirtyWords, 0, sizeof(uint64_t) * (words - browseDirtyWords));
+        browseDirtyWords = words;
+    }
+    browseLayout++;
+}
+
+// Lock-free; called by writers after they change a book's stock.
+void browseMarkStock(int id) {
+    __atomic_fetch_or(&browseDirty[id / 64], 1ull << (id % 64), __ATOMIC_RELEASE);
+    __atomic_fetch_add(&browseStockVersion, 1, __ATOMIC_RELEASE);
+}
+
+static void browseFree(BrowseView *v) {
+    free(v->all);
+    free(v->bySubject);
+    free(v->allRow);
+    free(v->subjectRow);
+    free(v->subjectSpan);
+    free(v);
+}
+
+static void browseAppend(char **buf, size_t *len, size_t *cap, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(*buf + *len, *cap - *len, fmt, ap);
+    va_end(ap);
+    if ((size_t)n >= *cap - *len) {
+        *cap = (*len + (size_t)n + 1) * 2;
+        *buf = xrealloc(*buf, *cap);
+        va_start(ap, fmt);
+        vsnprintf(*buf + *len, *cap - *len, fmt, ap);
+        va_end(ap);
+    }
+    *len += (size_t)n;
+}
+
+static BrowseView *browseRender(uint64_t version) {
+    BrowseView *v = xrealloc(NULL, sizeof(*v));
+    memset(v, 0, sizeof(*v));
+    v->version = version;
+    v->layout = browseLayout;
+    v->bookCount = lib.bookCount;
+    v->subjectCount = lib.subjectCount;
+    v->allRow = xrealloc(NULL, sizeof(size_t) * (size_t)(lib.bookCount + 1));
+    v->subjectRow = xrealloc(NULL, sizeof(size_t) * (size_t)(lib.bookCount + 1));
+    v->subjectSpan = xrealloc(NULL, sizeof(size_t) * 2 * (size_t)(lib.subjectCount + 1));
+    size_t allCap = TABLE_WIDTH * (size_t)(lib.bookCount + 1), subjectCap = allCap;
+    v->all = xrealloc(NULL, allCap);
+    v->bySubject = xrealloc(NULL, subjectCap);
+    v->all[0] = v->bySubject[0] = '\0';
+
+    for (int i = 0; i < lib.streamCount; i++) {
+        for (int j = 0; j < lib.streams[i].subjectCount; j++) {
+            Subject *sub = &lib.subjects[lib.streams[i].subjectIds[j]];
+            for (int k = 0; k < sub->bookCount; k++) {
+                int id = sub->bookIds[k];
+                v->allRow[id] = v->allLen;
+                browseAppend(&v->all, &v->allLen, &allCap, "| %-12s | %-20s | %-35s | %8d |\n",
+                             streamName(i), subjectName(lib.streams[i].subjectIds[j]), bookName(id), stockLevel(id));
+            }
+        }
+    }
+    for (int sub = 0; sub < lib.subjectCount; sub++) {
+        v->subjectSpan[2 * sub] = v->bySubjectLen;
+        for (int k = 0; k < lib.subjects[sub].bookCount; k++) {
+            int id = lib.subjects[sub].bookIds[k];
+            v->subjectRow[id] = v->bySubjectLen;
+            browseAppend(&v->bySubject, &v->bySubjectLen, &subjectCap, "| %-4d | %-35s | %8d |\n",
+                         k + 1, bookName(id), stockLevel(id));
+        }
+        v->subjectSpan[2 * sub + 1] = v->bySubjectLen;
+    }
+    return v;
+}
+
+static BrowseView *browseCopy(const BrowseView *v) {
+    BrowseView *c = xrealloc(NULL, sizeof(*c));
+    *c = *v;
+    c->refs = 0;
+    c->retired = 0;
+    c->all = xrealloc(NULL, v->allLen + 1);
+    memcpy(c->all, v->all, v->allLen + 1);
+    c->bySubject = xrealloc(NULL, v->bySubjectLen + 1);
+    memcpy(c->bySubject, v->bySubject, v->bySubjectLen + 1);
+    c->allRow = xrealloc(NULL, sizeof(size_t) * (size_t)(v->bookCount + 1));
+    memcpy(c->allRow, v->allRow, sizeof(size_t) * (size_t)v->bookCount);
+    c->subjectRow = xrealloc(NULL, sizeof(size_t) * (size_t)(v->bookCount + 1));
+    memcpy(c->subjectRow, v->subjectRow, sizeof(size_t) * (size_t)v->bookCount);
+    c->subjectSpan = xrealloc(NULL, sizeof(size_t) * 2 * (size_t)(v->subjectCount + 1));
+    memcpy(c->subjectSpan, v->subjectSpan, sizeof(size_t) * 2 * (size_t)v->subjectCount);
+    return c;
+}
+
+// Rewrites the quantity field at the end of the row starting at text + start.
+static void browsePatchRow(char *text, size_t start, const char *qty) {
+    char *end = strchr(text + start, '\n');
+    memcpy(end - 2 - BROWSE_QTY_WIDTH, qty, BROWSE_QTY_WIDTH);
+}
+
+// Takes the dirty flags and patches those rows. Returns -1 if a quantity no
+// longer fits its column, in which case the view must be rendered again.
+static int browsePatch(BrowseView *v) {
+    int rc = 0;
+    for (size_t w = 0; w < browseDirtyWords; w++) {
+        if (!__atomic_load_n(&browseDirty[w], __ATOMIC_RELAXED)) continue;
+        uint64_t bits = __atomic_exchange_n(&browseDirty[w], 0, __ATOMIC_ACQUIRE);
+        while (bits) {
+            int id = (int)(w * 64) + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            char qty[32];
+            if (snprintf(qty, sizeof(qty), "%8d", stockLevel(id)) != BROWSE_QTY_WIDTH) rc = -1;
+            if (rc == 0 && id < v->bookCount) {
+                browsePatchRow(v->all, v->allRow[id], qty);
+                browsePatchRow(v->bySubject, v->subjectRow[id], qty);
+            }
+        }
+    }
+    return rc;
+}
+
+// Returns the current view, bringing it up to date first. Release it with
+// browseRelease once printed. Issues and returns are never blocked: they
+// share stateLock with this and only set a dirty bit.
+const BrowseView *browseAcquire() {
+    pthread_rwlock_rdlock(&stateLock);
+    pthread_mutex_lock(&browseLock);
+    BrowseView *v = browseCurrent;
+    uint64_t version = __atomic_load_n(&browseStockVersion, __ATOMIC_ACQUIRE);
+    BrowseView *next = v;
+    if (!v || v->layout != browseLayout) {
+        for (size_t w = 0; w < browseDirtyWords; w++) __atomic_store_n(&browseDirty[w], 0, __ATOMIC_RELAXED);
+        next = browseRender(version);
+    } else if (v->version != version) {
+        next = v->refs ? browseCopy(v) : v;
+        if (browsePatch(next) == 0) {
+            next->version = version;
+        } else {
+            if (next != v) browseFree(next);
+            next = browseRender(version);
+        }
+    }
+    if (next != v && v) {
+        if (v->refs) v->retired = 1;
+        else browseFree(v);
+    }
+    browseCurrent = next;
+    next->refs++;
+    pthread_mutex_unlock(&browseLock);
+    pthread_rwlock_unlock(&stateLock);
+    return next;
+}
+
+void browseRelease(const BrowseView *view) {
+    BrowseView *v = (BrowseView *)view;
+    pthread_mutex_lock(&browseLock);
+    if (--v->refs == 0 && v->retired) browseFree(v);
+    pthread_mutex_unlock(&browseLock);
+}
+
+// --- Library books data ---
+static int catalogIdsUnsaved = 0;   // rows were given ids that books.csv lacks
+
+void loadBooks() {
+    uint64_t start = metricStart();
+    int errors = 0, withoutId = 0;
+    int loaded = readCatalogFile(CATALOG_FILE, loadCatalogRow, &withoutId, &errors);
+    if (loaded < 0) {
+        fprintf(stderr, "[!] Could not open catalog file '%s'. Starting with an empty catalog.\n", CATALOG_FILE);
+        metricEnd(METRIC_LOAD_CATALOG, start, 0);
+        return;
+    }
+    if (errors > 0)
+        fprintf(stderr, "[!] Skipped %d invalid line(s) in '%s'.\n", errors, CATALOG_FILE);
+    catalogAssignIds();
+    // Loans and logs keep the ids from now on, so they must not shift if the
+    // file is edited later. startupLoad saves them once the loans are in.
+    catalogIdsUnsaved = withoutId > 0;
+    metricEnd(METRIC_LOAD_CATALOG, start, 1);
+}
+
+// --- Startup ---
+// books.csv, students.dat and the log segments are independent files, so
+// they are read side by side; only legacy layouts that name books by title
+// wait for the catalog (catalogAwait). The search index is built after the
+// catalog task on its own, and searches block until it is ready.
+static Task catalogTask, studentsTask, logsTask, searchIndexTask, logIndexTask, browseTask;
+
+static void startupCatalog() {
+    loadBooks();
+    taskSubmit(&searchIndexTask);
+}
+
+static void startupLogIndex() {
+    uint64_t start = metricStart();
+    pthread_mutex_lock(&historyLock);
+    buildLogIndex();
+    pthread_mutex_unlock(&historyLock);
+    metricEnd(METRIC_BUILD_INDEX, start, 1);
+}
+
+static void startupBrowse() {
+    uint64_t start = metricStart();
+    browseRelease(browseAcquire());
+    metricEnd(METRIC_BUILD_INDEX, start, 1);
+}
+
+void startupLoad() {
+    catalogTask.run = startupCatalog;
+    studentsTask.run = loadStudents;
+    logsTask.run = loadLogStore;
+    searchIndexTask.run = searchIndexBuild;
+    catalogLoad = &catalogTask;
+    searchIndexDefer();
+    taskSubmit(&catalogTask);
+    taskSubmit(&studentsTask);
+    taskSubmit(&logsTask);
+    taskWait(&catalogTask);
+    taskWait(&studentsTask);
+    taskWait(&logsTask);
+    catalogLoad = NULL;
+    reconcileInventory();
+    // Only now do the copies on loan count towards the stock written back.
+    if (catalogIdsUnsaved && writeCatalogFile(CATALOG_FILE, 0) < 0)
+        fprintf(stderr, "[!] Could not save book ids to '%s': %s\n", CATALOG_FILE, strerror(errno));
+    catalogIdsUnsaved = 0;
+}
+
+// Report timelines and the rendered browse view are otherwise built on
+// first use; warming them here keeps that off the first request.
+void startupIndexes() {
+    logIndexTask.run = startupLogIndex;
+    browseTask.run = startupBrowse;
+    taskSubmit(&logIndexTask);
+    taskSubmit(&browseTask);
+}
+
+void printBookRow(const BrowseView *view, int id) {
+    const char *row = view->all + view->allRow[id];
+    fwrite(row, 1, (size_t)(strchr(row, '\n') + 1 - row), stdout);
+}
+
+void displayBooks() {
+    printHeader("Available Books");
+    printf("| %-12s | %-20s | %-35s | %8s |\n", "Stream", "Subject", "Book Name", "Quantity");
+    printLine(TABLE_WIDTH);
+    const BrowseView *view = browseAcquire();
+    fwrite(view->all, 1, view->allLen, stdout);
+    browseRelease(view);
+    printLine(TABLE_WIDTH);
+    waitForEnter();
+}
+
+void searchBook() {
+    char keyword[100];
+    clearInput();
+    printHeader("Search Book");
+    printf("Enter keywords to search (title, subject or stream): ");
+    fgets(keyword, sizeof(keyword), stdin);
+    keyword[strcspn(keyword, "\n")] = 0;
+
+    int *ids;
+    int found = searchIndexQuery(&reportArena, keyword, &ids);
+    int fuzzy = 0;
+    if (!found) {
+        // Nothing contains the words as typed; rank near misses instead.
+        FuzzyHit *hits;
+        found = searchIndexFuzzy(&reportArena, keyword, FUZZY_TOP_K, &hits);
+        ids = arenaAlloc(&reportArena, sizeof(int) * (size_t)(found + 1));
+        for (int i = 0; i < found; i++) ids[i] = hits[i].id;
+        fuzzy = found > 0;
+    }
+    if (fuzzy) printf("\nNo exact matches for '%s'. Closest titles:\n", keyword);
+    printLine(TABLE_WIDTH);
+    printf("| %-12s | %-20s | %-35s | %8s |\n", "Stream", "Subject", "Book Name", "Quantity");
+    printLine(TABLE_WIDTH);
+    const BrowseView *view = browseAcquire();
+    for (int i = 0; i < found; i++) {
+        printBookRow(view, ids[i]);
+    }
+    browseRelease(view);
+    arenaReset(&reportArena, 0);
+    if (!found) {
+        printf("\n[!] No books found matching '%s'\n", keyword);
+    } else {
+        printLine(TABLE_WIDTH);
+    }
+    waitForEnter();
+}
+
+void filterBooksByStreamAndSubject() {
+    printHeader("Filter Books by Stream & Subject");
+    printf("Available Streams:\n");
+    for (int i = 0; i < lib.streamCount; i++) {
+        printf("%d. %s\n", i+1, streamName(i));
+    }
+    printf("\nEnter stream number: ");
+    int s;
+    scanf("%d", &s);
+    clearInput();
+    if (s < 1 || s > lib.streamCount) {
+        printf("\n[!] Invalid stream number.\n");
+        waitForEnter();
+        return;
+    }
+    s--;
+
+    Stream *st = &lib.streams[s];
+    printf("\nSubjects in %s:\n", streamName(s));
+    for (int j = 0; j < st->subjectCount; j++) {
+        printf("%d. %s\n", j+1, subjectName(st->subjectIds[j]));
+    }
+    printf("\nEnter subject number: ");
+    int sub;
+    scanf("%d", &sub);
+    clearInput();
+    if (sub < 1 || sub > st->subjectCount) {
+        printf("\n[!] Invalid subject number.\n");
+        waitForEnter();
+        return;
+    }
+    sub--;
+
+    int subjectId = st->subjectIds[sub];
+    printHeader("Filtered Books");
+    printf("| %-4s | %-35s | %8s |\n", "No.", "Book Name", "Quantity");
+    printLine(TABLE_WIDTH);
+    const BrowseView *view = browseAcquire();
+    if (subjectId < view->subjectCount) {
+        size_t start = view->subjectSpan[2 * subjectId], end = view->subjectSpan[2 * subjectId + 1];
+        fwrite(view->bySubject + start, 1, end - start, stdout);
+    }
+    browseRelease(view);
+    printLine(TABLE_WIDTH);
+    waitForEnter();
+}
+
+// Issue, Return and other functions unchanged (with small UI improvements) ...
+
+int calculateFine(time_t dueDate, time_t returnDate) {
+    if (returnDate <= dueDate)
+        return 0;
+    double secondsLate = difftime(returnDate, dueDate);
+    int daysLate = (int)(secondsLate / (60*60*24));
+    if (daysLate == 0) daysLate = 1;
+    return daysLate * FINE_PER_DAY;
+}
+
+// Lends one copy and records it in the journal and the log. Returns the loan
+// slot, or -1 if the book is out of stock or the student is at the limit.
+// A copy set aside for the student's hold is lent before the shelf is tried.
+// The caller commits *seq before reporting success.
+int issueCopy(int studentIndex, int id, uint64_t *seq) {
+    uint64_t start = metricStart();
+    int slot = -1;
+    *seq = 0;
+    if (id < 0) {
+        metricEnd(METRIC_ISSUE, start, 0);
+        return -1;
+    }
+    pthread_rwlock_rdlock(&stateLock);
+    lockStudent(studentIndex);
+    Student *st = &students[studentIndex];
+    uint32_t bookId = lib.bookId[id];
+    time_t now = time(NULL);
+    // Holds are placed under the student's lock, so if nobody holds the book
+    // this student cannot either, and the shelf is all there is.
+    int held = holdActive(id);
+    StudentHold hold = { 0 };
+    if (held) {
+        holdLockBook(bookId);
+        expireHolds(bookId, now);
+        holdGet(studentIndex, bookId, &hold);
+    }
+    if (st->activeCount < config.maxLoans && (hold.ready || stockTake(id))) {
+        slot = recordLoan(studentIndex, bookId, now, now + BORROW_DAYS * 24 * 60 * 60);
+        pthread_mutex_lock(&historyLock);
+        *seq = journalIssue(studentIndex, slot);
+        addLog(studentIndex, st->username, bookId, "Issued", now, *seq);
+        pthread_mutex_unlock(&historyLock);
+        // Dropped only once journaled; see placeHold.
+        if (held) holdClaim(studentIndex, bookId);
+    }
+    if (held) holdUnlockBook(bookId);
+    unlockStudent(studentIndex);
+    pthread_rwlock_unlock(&stateLock);
+    metricEnd(METRIC_ISSUE, start, slot >= 0);
+    return slot;
+}
+
+// Returns -1 if the slot holds no outstanding loan.
+int returnCopy(int studentIndex, int slot, uint64_t *seq) {
+    uint64_t start = metricStart();
+    int rc;
+    *seq = 0;
+    pthread_rwlock_rdlock(&stateLock);
+    lockStudent(studentIndex);
+    Student *st = &students[studentIndex];
+    rc = slot >= 0 && slot < st->loanCount && !st->loans[slot].isReturned ? 0 : -1;
+    if (rc == 0) {
+        time_t now = time(NULL);
+        uint32_t bookId = st->loans[slot].bookId;
+        int id = catalogRowById(bookId), shelved = 0;
+        loanClose(studentIndex, slot, now);
+        // Replay gives the copy to a holder if a hold was journaled before
+        // this return, so the check is repeated where the order is fixed.
+        if (!holdActive(id)) {
+            pthread_mutex_lock(&historyLock);
+            if (!holdActive(id)) {
+                if (id >= 0) stockGive(id);
+                *seq = journalReturn(studentIndex, slot);
+                addLog(studentIndex, st->username, bookId, "Returned", now, *seq);
+                shelved = 1;
+            }
+            pthread_mutex_unlock(&historyLock);
+        }
+        if (!shelved) {
+            holdLockBook(bookId);
+            holdPassCopy(bookId, now);
+            pthread_mutex_lock(&historyLock);
+            *seq = journalReturn(studentIndex, slot);
+            addLog(studentIndex, st->username, bookId, "Returned", now, *seq);
+            pthread_mutex_unlock(&historyLock);
+            expireHolds(bookId, now);
+            holdUnlockBook(bookId);
+        }
+    }
+    unlockStudent(studentIndex);
+    pthread_rwlock_unlock(&stateLock);
+    metricEnd(METRIC_RETURN, start, rc == 0);
+    return rc;
+}
+
+// Queues the student for a book with no copy on the shelf. Returns NULL, or
+// why the hold was refused. The caller commits *seq before reporting success.
+const char *placeHold(int studentIndex, int id, uint64_t *seq) {
+    const char *err = NULL;
+    *seq = 0;
+    if (id < 0) return "unknown book";
+    pthread_rwlock_rdlock(&stateLock);
+    lockStudent(studentIndex);
+    Student *st = &students[studentIndex];
+    uint32_t bookId = lib.bookId[id];
+    time_t now = time(NULL);
+    holdLockBook(bookId);
+    expireHolds(bookId, now);
+    StudentHold hold;
+    pthread_mutex_lock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    int holdCount = st->holdCount;
+    pthread_mutex_unlock(&holdListLocks[studentIndex % STUDENT_LOCK_STRIPES]);
+    if (holdGet(studentIndex, bookId, &hold) == 0) err = "already on hold";
+    else if (studentActiveLoan(st, bookId) >= 0) err = "already on loan";
+    else if (stockLevel(id) > 0) err = "copies are available";
+    else if (holdCount >= config.maxLoans) err = "hold limit reached";
+    else {
+        // Counted before it is journaled, so no return journaled after it
+        // can see nobody holding the book and shelve the copy.
+        __atomic_fetch_add(&holdQueues[id].holders, 1, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&historyLock);
+        // The journal sequence number is the hold's place in the queue.
+        *seq = journalHold(JOURNAL_HOLD, studentIndex, bookId, now);
+        addLog(studentIndex, st->username, bookId, "Held", now, *seq);
+        pthread_mutex_unlock(&historyLock);
+        applyHoldPlace(studentIndex, bookId, now, *seq);
+        __atomic_fetch_sub(&holdQueues[id].holders, 1, __ATOMIC_RELEASE);
+    }
+    holdUnlockBook(bookId);
+    unlockStudent(studentIndex);
+    pthread_rwlock_unlock(&stateLock);
+    return err;
+}
+
+// Returns -1 if the student holds no such book.
+int cancelHold(int studentIndex, int id, uint64_t *seq) {
+    int rc = -1;
+    *seq = 0;
+    if (id < 0) return -1;
+    pthread_rwlock_rdlock(&stateLock);
+    uint32_t bookId = lib.bookId[id];
+    time_t now = time(NULL);
+    StudentHold hold;
+    holdLockBook(bookId);
+    if (holdGet(studentIndex, bookId, &hold) == 0) {
+        pthread_mutex_lock(&historyLock);
+        *seq = journalHold(JOURNAL_HOLD_CANCEL, studentIndex, bookId, now);
+        addLog(studentIndex, students[studentIndex].username, bookId, "Cancelled", now, *seq);
+        pthread_mutex_unlock(&historyLock);
+        // Dropped only once journaled; see placeHold.
+        rc = applyHoldCancel(studentIndex, bookId, now);
+    }
+    holdUnlockBook(bookId);
+    pthread_rwlock_unlock(&stateLock);
+    return rc;
+}
+
+void issueBook(int loggedInStudentIndex) {
+    Student *student = &students[loggedInStudentIndex];
+    printHeader("Issue Book");
+
+    if(student->activeCount >= config.maxLoans) {
+        printf("[!] You have reached the maximum limit of issued books.\n");
+        waitForEnter();
+        return;
+    }
+
+    filterBooksByStreamAndSubject();
+
+    printf("Enter stream number to issue book from: ");
+    int s; scanf("%d", &s);
+    clearInput();
+    if (s < 1 || s > lib.streamCount) {
+        printf("\n[!] Invalid stream number.\n");
+        waitForEnter();
+        return;
+    }
+    s--;
+
+    printf("Enter subject number: ");
+    int sub; scanf("%d", &sub);
+    clearInput();
+    if (sub < 1 || sub > lib.streams[s].subjectCount) {
+        printf("\n[!] Invalid subject number.\n");
+        waitForEnter();
+        return;
+    }
+    sub--;
+
+    printf("Enter book number: ");
+    int b; scanf("%d", &b);
+    clearInput();
+    int id = catalogBookAt(s, sub, b - 1);
+    if (id < 0) {
+        printf("\n[!] Invalid book number.\n");
+        waitForEnter();
+        return;
+    }
+
+    uint64_t seq;
+    int slot = issueCopy(loggedInStudentIndex, id, &seq);
+    if (slot >= 0) {
+        journalCommitOrWarn(seq);
+        IssuedBook *ib = &student->loans[slot];
+        printf("\n[+] Book '%s' issued successfully!\n", bookNameById(ib->bookId));
+        printf("Due date: ");
+        printDate(ib->dueDate);
+        printf("\n");
+    } else {
+        printf("\n[!] Sorry, book not available currently.\n");
+        printf("Place a hold so the next returned copy is kept for you? (y/n): ");
+        char answer[8] = "";
+        if (fgets(answer, sizeof(answer), stdin) && (answer[0] == 'y' || answer[0] == 'Y')) {
+            const char *err = placeHold(loggedInStudentIndex, id, &seq);
+            if (err) {
+                printf("[!] Could not place a hold: %s.\n", err);
+            } else {
+                journalCommitOrWarn(seq);
+                int place = holdPosition(loggedInStudentIndex, lib.bookId[id]);
+                printf("[+] Hold placed; you are number %d in the queue.\n", place);
+            }
+        }
+    }
+    waitForEnter();
+}
+
+void returnBook(int loggedInStudentIndex) {
+    Student *student = &students[loggedInStudentIndex];
+    printHeader("Return Book");
+
+    if (student->loanCount == 0) {
+        printf("[!] You have no issued books to return.\n");
+        waitForEnter();
+        return;
+    }
+    if (student->activeCount == 0) {
+        printf("All books have been returned.\n");
+        waitForEnter();
+        return;
+    }
+
+    printf("| %-4s | %-35s | %-12s |\n", "No.", "Book Name", "Due Date");
+    printLine(TABLE_WIDTH);
+    for (int i = 0; i < student->activeCount; i++) {
+        IssuedBook *ib = &student->loans[student->active[i]];
+        printf("| %-4d | %-35s | ", i+1, bookNameById(ib->bookId));
+        printDate(ib->dueDate);
+        printf(" |\n");
+    }
+    printLine(TABLE_WIDTH);
+
+    printf("Enter the number of the book to return: ");
+    int choice;
+    scanf("%d", &choice);
+    clearInput();
+    if (choice < 1 || choice > student->activeCount) {
+        printf("[!] Invalid choice.\n");
+        waitForEnter();
+        return;
+    }
+
+    int slot = student->active[choice - 1];
+    uint64_t seq;
+    if (returnCopy(loggedInStudentIndex, slot, &seq) != 0) {
+        printf("[!] Invalid choice.\n");
+        waitForEnter();
+        return;
+    }
+    journalCommitOrWarn(seq);
+    IssuedBook *ib = &student->loans[slot];
+
+    int fine = calculateFine(ib->dueDate, ib->returnDate);
+    if (fine > 0) {
+        printf("\n[!] Book '%s' returned. You have a fine of %d units for late return.\n", bookNameById(ib->bookId), fine);
+    } else {
+        printf("\n[+] Book '%s' returned successfully, no fine.\n", bookNameById(ib->bookId));
+    }
+
+    waitForEnter();
+}
+
+void showIssuedBooksByStudent(int studentIndex) {
+    Student *student = &students[studentIndex];
+    printHeader("My Issued Books");
+    if (student->loanCount == 0) {
+        printf("You have no issued books.\n");
+    } else {
+        printf("| %-4s | %-35s | %-12s | %-12s | %-10s |\n", "No.", "Book Name", "Issued On", "Due Date", "Status");
+        printLine(TABLE_WIDTH);
+        for (int i = 0; i < student->loanCount; i++) {
+            IssuedBook *ib = &student->loans[i];
+            printf("| %-4d | %-35s | ", i+1, bookNameById(ib->bookId));
+            printDate(ib->issueDate);
+            printf(" | ");
+            printDate(ib->dueDate);
+            printf(" | %-10s |\n", ib->isReturned ? "Returned" : "Issued");
+        }
+        printLine(TABLE_WIDTH);
+    }
+    waitForEnter();
+}
+
+void showHolds(int studentIndex) {
+    printHeader("My Holds");
+    StudentHold *holds;
+    int n = studentHoldsCopy(studentIndex, &holds);
+    int *places = xrealloc(NULL, sizeof(int) * (size_t)(n + 1));
+    for (int i = 0; i < n; i++) places[i] = holdPosition(studentIndex, holds[i].bookId);
+
+    if (n == 0) {
+        printf("You have no books on hold.\n");
+    } else {
+        // Ready holds show the pickup deadline, waiting ones when they were placed.
+        printf("| %-4s | %-35s | %-12s | %-12s |\n", "No.", "Book Name", "Status", "Placed/Until");
+        printLine(TABLE_WIDTH);
+        for (int i = 0; i < n; i++) {
+            char status[32];
+            if (holds[i].ready) snprintf(status, sizeof(status), "Ready");
+            else snprintf(status, sizeof(status), "Waiting #%d", places[i]);
+            printf("| %-4d | %-35s | %-12s | ", i + 1, bookNameById(holds[i].bookId), status);
+            printDate(holds[i].time);
+            printf(" |\n");
+        }
+        printLine(TABLE_WIDTH);
+        printf("Enter the number of a hold to cancel (0 to go back): ");
+        int choice = 0;
+        scanf("%d", &choice);
+        clearInput();
+        uint64_t seq;
+        if (choice >= 1 && choice <= n &&
+            cancelHold(studentIndex, catalogRowById(holds[choice - 1].bookId), &seq) == 0) {
+            journalCommitOrWarn(seq);
+            printf("[+] Hold on '%s' cancelled.\n", bookNameById(holds[choice - 1].bookId));
+        } else if (choice != 0) {
+            printf("[!] Invalid choice.\n");
+        }
+    }
+    free(holds);
+    free(places);
+    waitForEnter();
+}
+
+// Parses YYYY-MM-DD as local midnight, or the last second of that day when
+// endOfDay is set. Returns 1 for empty input and -1 if it is not a date.
+static int parseReportDate(const char *text, int endOfDay, time_t *out) {
+    if (!*text) return 1;
+    struct tm tm = {0};
+    char extra;
+    if (sscanf(text, "%d-%d-%d%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &extra) != 3 ||
+        tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 || tm.tm_mday > 31)
+        return -1;
+    tm.tm_year -= 1900;
+    tm.tm_mon--;
+    tm.tm_isdst = -1;
+    if (endOfDay) {
+        tm.tm_hour = 23;
+        tm.tm_min = 59;
+        tm.tm_sec = 59;
+    }
+    *out = mktime(&tm);
+    return *out == (time_t)-1 ? -1 : 0;
+}
+
+static void readReportLine(const char *prompt, char *buf, int size) {
+    printf("%s", prompt);
+    if (!fgets(buf, size, stdin)) buf[0] = '\0';
+    buf[strcspn(buf, "\n")] = 0;
+}
+
+void adminReportMenu() {
+    char fromText[32], toText[32], filter[CATALOG_FIELD_LENGTH];
+    time_t from = 0, to = 0;
+    printHeader("Admin Report: Issued/Returned Books");
+    readReportLine("From date (YYYY-MM-DD, Enter for earliest): ", fromText, sizeof(fromText));
+    readReportLine("To date (YYYY-MM-DD, Enter for latest): ", toText, sizeof(toText));
+    int hasFrom = parseReportDate(fromText, 0, &from);
+    int hasTo = parseReportDate(toText, 1, &to);
+    if (hasFrom < 0 || hasTo < 0) {
+        printf("\n[!] Dates must be in YYYY-MM-DD form.\n");
+        waitForEnter();
+        return;
+    }
+    readReportLine("Filter by username or exact book title (Enter for all): ", filter, sizeof(filter));
+
+    // The timeline is looked up again for every page because addLog may
+    // grow it in the meantime; the cursor is a position within it.
+    int cursor = -1;
+    while (1) {
+        int ids[REPORT_PAGE_SIZE];
+        LogEntry rows[REPORT_PAGE_SIZE];
+        int shown = 0, first = 0, end = 0;
+
+        pthread_mutex_lock(&historyLock);
+        buildLogIndex();
+        const Timeline *t = &logIdx.all;
+        if (filter[0]) {
+            t = logIndexFilter(filter);
+        }
+        if (t) {
+            first = hasFrom == 0 ? timelineLowerBound(t, from) : 0;
+            end = hasTo == 0 ? timelineLowerBound(t, to + 1) : t->count;
+            if (end < first) end = first;
+            if (cursor < first) cursor = first;
+            if (cursor > end) cursor = end;
+            while (shown < REPORT_PAGE_SIZE && cursor + shown < end) {
+                ids[shown] = t->entries[cursor + shown].logIndex;
+                readLog(ids[shown], &rows[shown]);
+                shown++;
+            }
+        }
+        pthread_mutex_unlock(&historyLock);
+
+        printHeader("Admin Report: Issued/Returned Books");
+        printf("| %-6s | %-15s | %-33s | %-8s | %-19s |\n", "No.", "User", "Book Name", "Action", "Date/Time");
+        printLine(TABLE_WIDTH);
+        for (int k = 0; k < shown; k++) {
+            const LogEntry *e = &rows[k];
+            char timebuff[20];
+            struct tm tm_info;
+            localtime_r(&e->timestamp, &tm_info);
+            strftime(timebuff, sizeof(timebuff), "%Y-%m-%d %H:%M:%S", &tm_info);
+            printf("| %-6d | %-15.15s | %-33.33s | %-8s | %-19s |\n",
+                ids[k] + 1, e->username, bookNameById(e->bookId), e->action, timebuff);
+        }
+        if (shown == 0) {
+            printf("No records found.\n");
+        }
+        printLine(TABLE_WIDTH);
+
+        int total = end - first;
+        int pages = (total + REPORT_PAGE_SIZE - 1) / REPORT_PAGE_SIZE;
+        int page = (cursor - first) / REPORT_PAGE_SIZE + 1;
+        if (pages == 0) pages = page = 1;
+        printf("Page %d of %d (%d records)\n", page, pages, total);
+        char cmd[16];
+        readReportLine("[n]ext, [p]revious, [f]irst, [l]ast, [q]uit: ", cmd, sizeof(cmd));
+        switch (tolower((unsigned char)cmd[0])) {
+            case 'n':
+            case '\0':
+                if (cursor + REPORT_PAGE_SIZE < end) cursor += REPORT_PAGE_SIZE;
+                break;
+            case 'p': cursor -= REPORT_PAGE_SIZE; break;
+            case 'f': cursor = first; break;
+            case 'l': cursor = first + (pages - 1) * REPORT_PAGE_SIZE; break;
+            case 'q': return;
+        }
+        if (feof(stdin)) return;
+    }
+}
+
+void overdueReportMenu() {
+    printHeader("Overdue Loans & Fines");
+    DueEntry *due;
+    long long totalFine;
+    time_t now = time(NULL);
+    int n = dueIndexOverdue(&reportArena, now, &due, &totalFine);
+    printf("| %-15s | %-35s | %-10s | %6s | %6s |\n", "User", "Book Name", "Due Date", "Days", "Fine");
+    printLine(TABLE_WIDTH);
+    for (int k = 0; k < n; k++) {
+        IssuedBook *ib = &students[due[k].student].loans[due[k].slot];
+        char dateBuff[11];
+        struct tm tm_info;
+        localtime_r(&due[k].dueDate, &tm_info);
+        strftime(dateBuff, sizeof(dateBuff), "%Y-%m-%d", &tm_info);
+        printf("| %-15.15s | %-35.35s | %-10s | %6d | %6d |\n", students[due[k].student].username,
+               bookNameById(ib->bookId), dateBuff, (int)(difftime(now, due[k].dueDate) / (60 * 60 * 24)),
+               calculateFine(due[k].dueDate, now));
+    }
+    if (n == 0) printf("No overdue loans.\n");
+    printLine(TABLE_WIDTH);
+    printf("%d overdue loan(s), outstanding fines: %lld\n", n, totalFine);
+    arenaReset(&reportArena, 0);
+    waitForEnter();
+}
+
+void addBookMenu() {
+    printHeader("Add Book");
+    char fields[3][CATALOG_FIELD_LENGTH + 1], quantityText[16];
+    const char *prompts[3] = { "Stream: ", "Subject: ", "Title: " };
+    char *values[4];
+    for (int i = 0; i < 3; i++) {
+        readReportLine(prompts[i], fields[i], sizeof(fields[i]));
+        size_t len = strlen(fields[i]);
+        if (len == 0 || len >= CATALOG_FIELD_LENGTH) {
+            printf("\n[!] Each field must be 1 to %d characters.\n", CATALOG_FIELD_LENGTH - 1);
+            waitForEnter();
+            return;
+        }
+        values[i] = fields[i];
+    }
+    readReportLine("Copies: ", quantityText, sizeof(quantityText));
+    char *end;
+    long quantity = strtol(quantityText, &end, 10);
+    if (end == quantityText || *end || quantity < 0 || quantity > 1000000) {
+        printf("\n[!] Invalid number of copies.\n");
+        waitForEnter();
+        return;
+    }
+    values[3] = quantityText;
+
+    int id = catalogAddTitle(values, (int)quantity);
+    if (id == -1) printf("\n[!] A book with this title is already in the catalog.\n");
+    else if (id < 0) printf("\n[!] The book was added but '%s' could not be saved.\n", CATALOG_FILE);
+    else printf("\n[+] Added '%s' under %s / %s.\n", bookName(id), values[0], values[1]);
+    waitForEnter();
+}
+
+void metricsMenu() {
+    MetricShard m;
+    metricsCollect(&m);
+    printHeader("Metrics");
+    printf("| %-13s | %8s | %6s | %8s | %7s | %7s | %8s |\n",
+           "Operation", "Calls", "Failed", "Mean us", "p50 us", "p99 us", "Max us");
+    printLine(TABLE_WIDTH);
+    for (int op = 0; op < METRIC_OPS; op++) {
+        if (!m.calls[op]) continue;
+        printf("| %-13s | %8llu | %6llu | %8.1f | %7.1f | %7.1f | %8.1f |\n", metricOpNames[op],
+               (unsigned long long)m.calls[op], (unsigned long long)m.failed[op],
+               m.totalNs[op] / 1000.0 / (double)m.calls[op], metricQuantileUs(&m, op, 0.5),
+               metricQuantileUs(&m, op, 0.99), m.maxNs[op] / 1000.0);
+    }
+    printLine(TABLE_WIDTH);
+    printf("| %-13s | %16s | %16s |\n", "File", "Bytes read", "Bytes written");
+    printLine(TABLE_WIDTH);
+    for (int k = 0; k < IO_KINDS; k++) {
+        printf("| %-13s | %16llu | %16llu |\n", ioKindNames[k],
+               (unsigned long long)m.bytesRead[k], (unsigned long long)m.bytesWritten[k]);
+    }
+    printLine(TABLE_WIDTH);
+    printf("Percentiles are histogram bucket bounds (powers of two).\n");
+    if (config.metricsInterval > 0)
+        printf("Also written to %s every %d seconds.\n", METRICS_FILE, config.metricsInterval);
+    waitForEnter();
+}
+
+void adminMenu() {
+    while (1) {
+        printHeader("Admin Menu");
+        printf("1. View All Books\n");
+        printf("2. Search Book\n");
         printf("3. Filter Books by Stream & Subject\n");
         printf("4. View Issued/Returned Logs\n");
-        printf("5. Logout\n");
+        printf("5. Overdue Loans & Fines\n");
+        printf("6. Add Book\n");
+        printf("7. Metrics\n");
+        printf("8. Logout\n");
         printf("\nEnter choice: ");
-        int choice;
-        scanf("%d", &choice);
+        int choice = 0;
+        if (scanf("%d", &choice) != 1 && feof(stdin)) return;
         clearInput();
         switch (choice) {
             case 1: displayBooks(); break;
             case 2: searchBook(); break;
             case 3: filterBooksByStreamAndSubject(); break;
             case 4: adminReportMenu(); break;
-            case 5: return;
+            case 5: overdueReportMenu(); break;
+            case 6: addBookMenu(); break;
+            case 7: metricsMenu(); break;
+            case 8: return;
+            default: printf("\n[!] Invalid choice\n"); waitForEnter();
+        }
+    }
+}
+
+void studentMenu(int loggedInStudentIndex) {
+    while (1) {
+        printHeader("Student Menu");
+        StudentHold *holds;
+        int ready = 0, n = studentHoldsCopy(loggedInStudentIndex, &holds);
+        for (int i = 0; i < n; i++) ready += holds[i].ready;
+        free(holds);
+        if (ready) printf("[+] %d book(s) you held are waiting for pickup; see My Holds.\n\n", ready);
+        printf("1. View All Books\n");
+        printf("2. Search Book\n");
+        printf("3. Filter Books by Stream & Subject\n");
+        printf("4. Issue Book\n");
+        printf("5. Return Book\n");
+        printf("6. View My Issued Books\n");
+        printf("7. My Holds\n");
+        printf("8. Logout\n");
+        printf("\nEnter choice: ");
+        int choice = 0;
+        if (scanf("%d", &choice) != 1 && feof(stdin)) return;
+        clearInput();
+        switch (choice) {
+            case 1: displayBooks(); break;
+            case 2: searchBook(); break;
+            case 3: filterBooksByStreamAndSubject(); break;
+            case 4: issueBook(loggedInStudentIndex); break;
+            case 5: returnBook(loggedInStudentIndex); break;
+            case 6: showIssuedBooksByStudent(loggedInStudentIndex); break;
+            case 7: showHolds(loggedInStudentIndex); break;
+            case 8: return;
             default: printf("\n[!] Invalid choice\n"); waitForEnter();
         }
     }
 }
 
-void studentMenu(int loggedInStudentIndex) {
-    while (1) {
-        printHeader("Student Menu");
-        printf("1. View All Books\n");
-        printf("2. Search Book\n");
-        printf("3. Filter Books by Stream & Subject\n");
-        printf("4. Issue Book\n");
-        printf("5. Return Book\n");
-        printf("6. View My Issued Books\n");
-        printf("7. Logout\n");
-        printf("\nEnter choice: ");
-        int choice;
-        scanf("%d", &choice);
-        clearInput();
-        switch (choice) {
-            case 1: displayBooks(); break;
-            case 2: searchBook(); break;
-            case 3: filterBooksByStreamAndSubject(); break;
-            case 4: issueBook(loggedInStudentIndex); break;
-            case 5: returnBook(loggedInStudentIndex); break;
-            case 6: showIssuedBooksByStudent(loggedInStudentIndex); break;
-            case 7: return;
-            default: printf("\n[!] Invalid choice\n"); waitForEnter();
+void loginSystem() {
+    while (1) {
+        printHeader("Library Management System");
+        printf("1. Admin Login\n");
+        printf("2. Student Login\n");
+        printf("3. Student Signup\n");
+        printf("4. Exit\n");
+        printf("\nEnter choice: ");
+        int choice = 0;
+        if (scanf("%d", &choice) != 1 && feof(stdin)) break;
+        clearInput();
+        if(choice == 1){
+            char adminUser[50], adminPass[PASSWORD_LENGTH];
+            printHeader("Admin Login");
+            printf("Admin username: ");
+            fgets(adminUser, sizeof(adminUser), stdin);
+            adminUser[strcspn(adminUser, "\n")] = 0;
+
+            printf("Admin password: ");
+            getPassword(adminPass, PASSWORD_LENGTH);
+
+            if (validateAdminLogin(adminUser, adminPass)) {
+                printf("\nAdmin login successful.\n");
+                waitForEnter();
+                adminMenu();
+            } else {
+                printf("\n[!] Invalid admin credentials.\n");
+                waitForEnter();
+            }
+        }
+        else if(choice == 2){
+            int sIndex = studentLogin();
+            if(sIndex != -1)
+                studentMenu(sIndex);
+        }
+        else if(choice == 3){
+            signup();
+        }
+        else if(choice == 4){
+            break;
+        }
+        else{
+            printf("\n[!] Invalid choice.\n");
+            waitForEnter();
+        }
+    }
+}
+
+// --- Command line mode ---
+// Headless commands for scripts, kiosks and cron jobs. Output is fully
+// buffered TSV, or JSON with --json, and nothing is drawn on the terminal.
+struct CliCommand {
+    const char *name;
+    int minArgs;
+    int (*run)(char **args, int argCount, int json);
+    const char *usage;
+};
+
+static void printJsonString(const char *text) {
+    writeJsonString(stdout, text);
+}
+
+static int cliError(int json, const char *message) {
+    if (json) {
+        printf("{\"error\":");
+        printJsonString(message);
+        printf("}\n");
+    } else {
+        fprintf(stderr, "[!] %s\n", message);
+    }
+    return 1;
+}
+
+static void cliBookRow(int id, int json, int first) {
+    int subjectId = lib.bookSubject[id];
+    const char *stream = streamName(lib.subjects[subjectId].streamId);
+    if (!json) {
+        printf("%u\t%s\t%s\t%s\t%d\n", lib.bookId[id], stream, subjectName(subjectId), bookName(id), stockLevel(id));
+        return;
+    }
+    printf("%s{\"book\":%u,\"stream\":", first ? "" : ",", lib.bookId[id]);
+    printJsonString(stream);
+    printf(",\"subject\":");
+    printJsonString(subjectName(subjectId));
+    printf(",\"title\":");
+    printJsonString(bookName(id));
+    printf(",\"available\":%d}", stockLevel(id));
+}
+
+static void cliBookRows(const int *ids, int count, int json) {
+    if (json) putchar('[');
+    for (int k = 0; k < count; k++) cliBookRow(ids ? ids[k] : k, json, k == 0);
+    if (json) printf("]\n");
+}
+
+// A book is named by the id shown in search output or by its exact title.
+static int cliFindBook(const char *text) {
+    char *end;
+    long n = strtol(text, &end, 10);
+    if (*text && !*end) return n >= 1 && n <= CATALOG_MAX_BOOK_ID ? catalogRowById((uint32_t)n) : -1;
+    return catalogFindBook(text);
+}
+
+static int cliBooks(char **args, int argCount, int json) {
+    (void)args;
+    (void)argCount;
+    cliBookRows(NULL, lib.bookCount, json);
+    return 0;
+}
+
+static int cliSearch(char **args, int argCount, int json) {
+    char query[CATALOG_MAX_LINE] = "";
+    for (int i = 0; i < argCount; i++) {
+        if (i) strncat(query, " ", sizeof(query) - strlen(query) - 1);
+        strncat(query, args[i], sizeof(query) - strlen(query) - 1);
+    }
+    int *ids = NULL;
+    int n = searchIndexQuery(&reportArena, query, &ids);
+    cliBookRows(ids, n, json);
+    arenaReset(&reportArena, 0);
+    return 0;
+}
+
+// Best FUZZY_TOP_K books for words that may be misspelt, best first.
+static int cliFuzzy(char **args, int argCount, int json) {
+    char query[CATALOG_MAX_LINE] = "";
+    for (int i = 0; i < argCount; i++) {
+        if (i) strncat(query, " ", sizeof(query) - strlen(query) - 1);
+        strncat(query, args[i], sizeof(query) - strlen(query) - 1);
+    }
+    FuzzyHit *hits;
+    int n = searchIndexFuzzy(&reportArena, query, FUZZY_TOP_K, &hits);
+    int *ids = arenaAlloc(&reportArena, sizeof(int) * (size_t)(n + 1));
+    for (int i = 0; i < n; i++) ids[i] = hits[i].id;
+    cliBookRows(ids, n, json);
+    arenaReset(&reportArena, 0);
+    return 0;
+}
+
+static int cliLoans(char **args, int argCount, int json) {
+    (void)argCount;
+    int st = findStudent(args[0]);
+    if (st < 0) return cliError(json, "unknown student");
+    Student *student = &students[st];
+    if (json) putchar('[');
+    for (int i = 0; i < student->loanCount; i++) {
+        IssuedBook *ib = &student->loans[i];
+        const char *status = ib->isReturned ? "returned" : "issued";
+        int fine = ib->isReturned ? calculateFine(ib->dueDate, ib->returnDate)
+                                  : calculateFine(ib->dueDate, time(NULL));
+        if (!json) {
+            printf("%d\t%s\t%lld\t%lld\t%d\t%s\n", i + 1, status,
+                   (long long)ib->issueDate, (long long)ib->dueDate, fine, bookNameById(ib->bookId));
+            continue;
+        }
+        printf("%s{\"loan\":%d,\"status\":\"%s\",\"issued\":%lld,\"due\":%lld,\"fine\":%d,\"title\":",
+               i ? "," : "", i + 1, status, (long long)ib->issueDate, (long long)ib->dueDate, fine);
+        printJsonString(bookNameById(ib->bookId));
+        putchar('}');
+    }
+    if (json) printf("]\n");
+    return 0;
+}
+
+static int cliLoanResult(int st, int slot, int json) {
+    IssuedBook *ib = &students[st].loans[slot];
+    const char *status = ib->isReturned ? "returned" : "issued";
+    int fine = ib->isReturned ? calculateFine(ib->dueDate, ib->returnDate) : 0;
+    if (!json) {
+        printf("%s\t%s\t%lld\t%d\n", status, bookNameById(ib->bookId), (long long)ib->dueDate, fine);
+        return 0;
+    }
+    printf("{\"status\":\"%s\",\"title\":", status);
+    printJsonString(bookNameById(ib->bookId));
+    printf(",\"due\":%lld,\"fine\":%d}\n", (long long)ib->dueDate, fine);
+    return 0;
+}
+
+static int cliIssue(char **args, int argCount, int json) {
+    (void)argCount;
+    int st = findStudent(args[0]);
+    if (st < 0) return cliError(json, "unknown student");
+    int id = cliFindBook(args[1]);
+    if (id < 0) return cliError(json, "unknown book");
+    uint64_t seq;
+    if (students[st].activeCount >= config.maxLoans) return cliError(json, "loan limit reached");
+    int slot = issueCopy(st, id, &seq);
+    if (slot < 0) return cliError(json, "not available");
+    if (journalCommit(seq) != 0) return cliError(json, "could not save to the journal");
+    return cliLoanResult(st, slot, json);
+}
+
+static int cliReturn(char **args, int argCount, int json) {
+    (void)argCount;
+    int st = findStudent(args[0]);
+    if (st < 0) return cliError(json, "unknown student");
+    int id = cliFindBook(args[1]);
+    if (id < 0) return cliError(json, "unknown book");
+    int slot = studentActiveLoan(&students[st], lib.bookId[id]);
+    uint64_t seq;
+    if (slot < 0 || returnCopy(st, slot, &seq) != 0) return cliError(json, "not on loan to this student");
+    if (journalCommit(seq) != 0) return cliError(json, "could not save to the journal");
+    return cliLoanResult(st, slot, json);
+}
+
+// One line per hold: its place in the queue (0 once a copy is set aside),
+// the pickup deadline or the time it was placed, and how many are waiting.
+static int cliHolds(char **args, int argCount, int json) {
+    (void)argCount;
+    int st = findStudent(args[0]);
+    if (st < 0) return cliError(json, "unknown student");
+    StudentHold *holds;
+    int n = studentHoldsCopy(st, &holds);
+    if (json) putchar('[');
+    for (int i = 0; i < n; i++) {
+        StudentHold *h = &holds[i];
+        const char *status = h->ready ? "ready" : "waiting";
+        int place = holdPosition(st, h->bookId), waiting = holdWaiting(h->bookId);
+        if (!json) {
+            printf("%d\t%s\t%d\t%lld\t%d\t%s\n", i + 1, status, place, (long long)h->time, waiting,
+                   bookNameById(h->bookId));
+            continue;
+        }
+        printf("%s{\"hold\":%d,\"status\":\"%s\",\"place\":%d,\"%s\":%lld,\"waiting\":%d,\"title\":",
+               i ? "," : "", i + 1, status, place, h->ready ? "until" : "placed", (long long)h->time, waiting);
+        printJsonString(bookNameById(h->bookId));
+        putchar('}');
+    }
+    free(holds);
+    if (json) printf("]\n");
+    return 0;
+}
+
+static int cliHold(char **args, int argCount, int json) {
+    (void)argCount;
+    int st = findStudent(args[0]);
+    if (st < 0) return cliError(json, "unknown student");
+    int id = cliFindBook(args[1]);
+    if (id < 0) return cliError(json, "unknown book");
+    uint64_t seq;
+    const char *err = placeHold(st, id, &seq);
+    if (err) return cliError(json, err);
+    if (journalCommit(seq) != 0) return cliError(json, "could not save to the journal");
+    int place = holdPosition(st, lib.bookId[id]);
+    if (json) {
+        printf("{\"status\":\"waiting\",\"place\":%d,\"title\":", place);
+        printJsonString(bookName(id));
+        printf("}\n");
+    } else {
+        printf("waiting\t%d\t%s\n", place, bookName(id));
+    }
+    return 0;
+}
+
+static int cliUnhold(char **args, int argCount, int json) {
+    (void)argCount;
+    int st = findStudent(args[0]);
+    if (st < 0) return cliError(json, "unknown student");
+    int id = cliFindBook(args[1]);
+    if (id < 0) return cliError(json, "unknown book");
+    uint64_t seq;
+    if (cancelHold(st, id, &seq) != 0) return cliError(json, "not on hold for this student");
+    if (journalCommit(seq) != 0) return cliError(json, "could not save to the journal");
+    if (json) {
+        printf("{\"status\":\"cancelled\",\"title\":");
+        printJsonString(bookName(id));
+        printf("}\n");
+    } else {
+        printf("cancelled\t%s\n", bookName(id));
+    }
+    return 0;
+}
+
+static int cliReport(char **args, int argCount, int json) {
+    pthread_mutex_lock(&historyLock);
+    buildLogIndex();
+    const Timeline *t = &logIdx.all;
+    if (argCount > 0) {
+        t = logIndexFilter(args[0]);
+    }
+    if (json) putchar('[');
+    for (int k = 0; t && k < t->count; k++) {
+        LogEntry e;
+        readLog(t->entries[k].logIndex, &e);
+        if (!json) {
+            printf("%d\t%lld\t%s\t%s\t%s\n", t->entries[k].logIndex + 1, (long long)e.timestamp,
+                   e.action, e.username, bookNameById(e.bookId));
+            continue;
+        }
+        printf("%s{\"entry\":%d,\"time\":%lld,\"action\":", k ? "," : "",
+               t->entries[k].logIndex + 1, (long long)e.timestamp);
+        printJsonString(e.action);
+        printf(",\"user\":");
+        printJsonString(e.username);
+        printf(",\"title\":");
+        printJsonString(bookNameById(e.bookId));
+        putchar('}');
+    }
+    pthread_mutex_unlock(&historyLock);
+    if (json) printf("]\n");
+    return 0;
+}
+
+// Overdue as of the end of the given YYYY-MM-DD, or now.
+static int cliAsOf(char **args, int argCount, int index, time_t *asOf) {
+    *asOf = time(NULL);
+    return argCount > index ? parseReportDate(args[index], 1, asOf) : 0;
+}
+
+static int cliOverdue(char **args, int argCount, int json) {
+    time_t asOf;
+    if (cliAsOf(args, argCount, 0, &asOf) < 0) return cliError(json, "date must be YYYY-MM-DD");
+    DueEntry *due;
+    long long totalFine;
+    int n = dueIndexOverdue(&reportArena, asOf, &due, &totalFine);
+    if (json) printf("{\"overdue\":%d,\"totalFine\":%lld,\"loans\":[", n, totalFine);
+    for (int k = 0; k < n; k++) {
+        const char *user = students[due[k].student].username;
+        const char *title = bookNameById(students[due[k].student].loans[due[k].slot].bookId);
+        int fine = calculateFine(due[k].dueDate, asOf);
+        if (!json) {
+            printf("%s\t%lld\t%d\t%s\n", user, (long long)due[k].dueDate, fine, title);
+            continue;
+        }
+        printf("%s{\"user\":", k ? "," : "");
+        printJsonString(user);
+        printf(",\"title\":");
+        printJsonString(title);
+        printf(",\"due\":%lld,\"fine\":%d}", (long long)due[k].dueDate, fine);
+    }
+    if (json) printf("]}\n");
+    else fprintf(stderr, "[+] %d overdue loan(s), outstanding fines: %lld\n", n, totalFine);
+    arenaReset(&reportArena, 0);
+    return 0;
+}
+
+// notices [FILE [DATE]]: writes one overdue notice per loan as CSV, for a
+// scheduled job to mail out. The file appears atomically.
+static int cliNotices(char **args, int argCount, int json) {
+    time_t asOf;
+    char defaultPath[64], tmpPath[4096];
+    if (cliAsOf(args, argCount, 1, &asOf) < 0) return cliError(json, "date must be YYYY-MM-DD");
+    struct tm tm_info;
+    localtime_r(&asOf, &tm_info);
+    strftime(defaultPath, sizeof(defaultPath), "overdue-notices-%Y-%m-%d.csv", &tm_info);
+    const char *path = argCount > 0 ? args[0] : defaultPath;
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *fp = fopen(tmpPath, "w");
+    if (!fp) return cliError(json, strerror(errno));
+
+    DueEntry *due;
+    long long totalFine;
+    int n = dueIndexOverdue(&reportArena, asOf, &due, &totalFine);
+    fprintf(fp, "username,title,due_date,days_overdue,fine\n");
+    for (int k = 0; k < n; k++) {
+        char dateBuff[11];
+        localtime_r(&due[k].dueDate, &tm_info);
+        strftime(dateBuff, sizeof(dateBuff), "%Y-%m-%d", &tm_info);
+        writeCsvField(fp, students[due[k].student].username, ',');
+        writeCsvField(fp, bookNameById(students[due[k].student].loans[due[k].slot].bookId), ',');
+        fprintf(fp, "%s,%d,%d\n", dateBuff, (int)(difftime(asOf, due[k].dueDate) / (60 * 60 * 24)),
+                calculateFine(due[k].dueDate, asOf));
+    }
+    arenaReset(&reportArena, 0);
+    int ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return cliError(json, strerror(errno));
+    }
+    if (json) {
+        printf("{\"notices\":%d,\"totalFine\":%lld,\"file\":", n, totalFine);
+        printJsonString(path);
+        printf("}\n");
+    } else {
+        printf("%d\t%lld\t%s\n", n, totalFine, path);
+    }
+    return 0;
+}
+
+// import FILE [--dry-run]: merges CSV or JSONL rows into books.csv, skipping
+// titles already in the catalog or earlier in the batch.
+static int cliImport(char **args, int argCount, int json) {
+    const char *path = NULL;
+    int dryRun = 0;
+    for (int i = 0; i < argCount; i++) {
+        if (strcmp(args[i], "--dry-run") == 0) dryRun = 1;
+        else path = args[i];
+    }
+    if (!path) return cliError(json, "usage: import FILE [--dry-run]");
+    CatalogImport imp;
+    if (importCatalog(path, dryRun, &imp) < 0) return cliError(json, strerror(errno));
+    if (json) {
+        printf("{\"added\":%d,\"duplicates\":%d,\"errors\":%d,\"dryRun\":%s,"
+               "\"ms\":{\"seed\":%.1f,\"merge\":%.1f,\"index\":%.1f,\"write\":%.1f}}\n",
+               imp.added, imp.duplicates, imp.errors, dryRun ? "true" : "false",
+               imp.seedMs, imp.mergeMs, imp.indexMs, imp.writeMs);
+    } else {
+        printf("%d\t%d\t%d\n", imp.added, imp.duplicates, imp.errors);
+        int rows = imp.added + imp.duplicates;
+        fprintf(stderr, "[+] seed   %9.1f ms  (%d existing titles)\n", imp.seedMs, lib.bookCount - imp.added);
+        fprintf(stderr, "[+] merge  %9.1f ms  (%.0f rows/s)\n", imp.mergeMs,
+                imp.mergeMs > 0 ? rows / (imp.mergeMs / 1000.0) : 0.0);
+        fprintf(stderr, "[+] index  %9.1f ms\n", imp.indexMs);
+        fprintf(stderr, "[+] write  %9.1f ms%s\n", imp.writeMs, dryRun ? "  (dry run, not saved)" : "");
+    }
+    return 0;
+}
+
+// export [FILE|-] [--jsonl]: streams the catalog, with owned copy counts, to
+// a file or stdout.
+static int cliExport(char **args, int argCount, int json) {
+    const char *path = "-";
+    int jsonl = 0;
+    for (int i = 0; i < argCount; i++) {
+        if (strcmp(args[i], "--jsonl") == 0) jsonl = 1;
+        else path = args[i];
+    }
+    double start = nowMs();
+    int rows = strcmp(path, "-") == 0 ? writeCatalog(stdout, jsonl) : writeCatalogFile(path, jsonl);
+    if (rows < 0) return cliError(json, strerror(errno));
+    double ms = nowMs() - start;
+    if (strcmp(path, "-") == 0) {
+        fprintf(stderr, "[+] Exported %d row(s) in %.1f ms\n", rows, ms);
+    } else if (json) {
+        printf("{\"rows\":%d,\"ms\":%.1f,\"file\":", rows, ms);
+        printJsonString(path);
+        printf("}\n");
+    } else {
+        printf("%d\t%.1f\t%s\n", rows, ms, path);
+    }
+    return 0;
+}
+
+// stats: allocator counters, for debugging memory use. Each row is an arena
+// kind: allocations, bytes in use, peak bytes, bytes reserved in blocks and
+// regions freed at once.
+static int cliStats(char **args, int argCount, int json) {
+    (void)args;
+    (void)argCount;
+    if (json) putchar('[');
+    for (int k = 0; k < ARENA_KINDS; k++) {
+        const ArenaStats *as = &arenaStats[k];
+        if (!json) {
+            printf("%s\t%llu\t%zu\t%zu\t%zu\t%llu\n", as->name, (unsigned long long)as->allocs,
+                   as->used, as->peak, as->reserved, (unsigned long long)as->resets);
+            continue;
+        }
+        printf("%s{\"arena\":\"%s\",\"allocs\":%llu,\"bytes\":%zu,\"peak\":%zu,\"reserved\":%zu,\"resets\":%llu}",
+               k ? "," : "", as->name, (unsigned long long)as->allocs, as->used, as->peak, as->reserved,
+               (unsigned long long)as->resets);
+    }
+    if (json) printf("]\n");
+    return 0;
+}
+
+static const CliCommand cliCommands[] = {
+    { "books", 0, cliBooks, "books" },
+    { "search", 1, cliSearch, "search WORDS..." },
+    { "fuzzy", 1, cliFuzzy, "fuzzy WORDS..." },
+    { "loans", 1, cliLoans, "loans USER" },
+    { "issue", 2, cliIssue, "issue USER BOOK" },
+    { "return", 2, cliReturn, "return USER BOOK" },
+    { "holds", 1, cliHolds, "holds USER" },
+    { "hold", 2, cliHold, "hold USER BOOK" },
+    { "unhold", 2, cliUnhold, "unhold USER BOOK" },
+    { "report", 0, cliReport, "report [USER|TITLE]" },
+    { "overdue", 0, cliOverdue, "overdue [YYYY-MM-DD]" },
+    { "notices", 0, cliNotices, "notices [FILE [YYYY-MM-DD]]" },
+    { "import", 1, cliImport, "import FILE [--dry-run]" },
+    { "export", 0, cliExport, "export [FILE|-] [--jsonl]" },
+    { "stats", 0, cliStats, "stats" },
+};
+
+const CliCommand *findCliCommand(const char *name) {
+    for (size_t i = 0; i < sizeof(cliCommands) / sizeof(cliCommands[0]); i++) {
+        if (strcmp(cliCommands[i].name, name) == 0) return &cliCommands[i];
+    }
+    return NULL;
+}
+
+// args excludes the command name; a --json flag may appear anywhere.
+int runCliCommand(const CliCommand *cmd, int argc, char **args) {
+    static char stdoutBuffer[1 << 16];
+    setvbuf(stdout, stdoutBuffer, _IOFBF, sizeof(stdoutBuffer));
+    int json = 0, n = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(args[i], "--json") == 0) json = 1;
+        else args[n++] = args[i];
+    }
+    if (n < cmd->minArgs) {
+        fprintf(stderr, "usage: library %s [--json]\n", cmd->usage);
+        return 2;
+    }
+    int rc = cmd->run(args, n, json);
+    fflush(stdout);
+    return rc;
+}
+
+// --- Batch operations ---
+// Applies desk operations from a CSV file (or "-" for stdin), one per line:
+//   username,book title,issue|return
+// Every line gets an outcome row "line<TAB>OK|ERR<TAB>detail" on stdout. All
+// journal records are made durable by a single commit at the end, so a
+// batch costs one fdatasync however many lines it has.
+static const char *batchApply(const char *username, const char *title, const char *action, uint64_t *seq) {
+    pthread_rwlock_rdlock(&stateLock);
+    int st = findStudent(username);
+    pthread_rwlock_unlock(&stateLock);
+    if (st < 0) return "unknown student";
+    int id = catalogFindBook(title);
+    if (id < 0) return "unknown book";
+
+    if (strcasecmp(action, "issue") == 0) {
+        if (students[st].activeCount >= config.maxLoans) return "loan limit reached";
+        if (issueCopy(st, id, seq) < 0) return "not available";
+        return NULL;
+    }
+    if (strcasecmp(action, "return") == 0) {
+        lockStudent(st);
+        int slot = studentActiveLoan(&students[st], lib.bookId[id]);
+        unlockStudent(st);
+        if (slot < 0 || returnCopy(st, slot, seq) != 0) return "not on loan to this student";
+        return NULL;
+    }
+    return "action must be issue or return";
+}
+
+int runBatch(const char *path) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    char line[CATALOG_MAX_LINE];
+    char *fields[3];
+    int lineNo = 0, applied = 0, failed = 0;
+    uint64_t lastSeq = 0;
+    double start = nowMs();
+    while (fgets(line, sizeof(line), fp)) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!line[0] || line[0] == '#') continue;
+        int n = parseCatalogLine(line, fields, 3);
+        if (n == 3 && lineNo == 1 && strcasecmp(fields[0], "username") == 0) continue;
+
+        uint64_t seq = 0;
+        const char *error = n == 3 ? batchApply(fields[0], fields[1], fields[2], &seq)
+                                   : "expected username,title,action";
+        if (error) {
+            printf("%d\tERR\t%s\n", lineNo, error);
+            failed++;
+        } else {
+            printf("%d\tOK\t%s %s\n", lineNo, fields[2], fields[1]);
+            applied++;
+            if (seq > lastSeq) lastSeq = seq;
+        }
+    }
+    if (fp != stdin) fclose(fp);
+    double applyMs = nowMs() - start;
+    int saved = journalCommit(lastSeq) == 0;
+    double elapsed = nowMs() - start;
+    if (!saved) fprintf(stderr, "[!] Could not save the batch to the journal.\n");
+
+    int total = applied + failed;
+    fprintf(stderr, "[+] %d applied, %d failed in %.1f ms (commit %.1f ms), %.0f ops/s\n",
+            applied, failed, elapsed, elapsed - applyMs, elapsed > 0 ? total * 1000.0 / elapsed : 0.0);
+    return !saved ? 1 : failed ? 3 : 0;
+}
+
+// --- Network server ---
+// A line protocol over TCP (127.0.0.1) or a Unix socket. Each request is one
+// line; each response is a status line, "OK <rows>" or "ERR <reason>",
+// followed by <rows> tab-separated data lines:
+//   PING | LOGIN user password | ADMIN user password | SEARCH words | FUZZY words
+//   ISSUE book-no | RETURN loan-no | LOANS | REPORT cursor [count [filter]] | STATS | QUIT
+// One thread runs the epoll loop. Password checks go to the KDF pool and
+// issues/returns wait for their journal record to become durable; both wake
+// the loop through an eventfd instead of blocking it.
+enum { WAIT_NONE, WAIT_KDF, WAIT_COMMIT };
+
+typedef struct Session {
+    int fd;
+    int student;            // -1 until LOGIN succeeds
+    int admin;
+    int closing;
+    char in[SERVER_INPUT_LENGTH];
+    int inLen;
+    char *out;
+    size_t outLen, outSent, outCap;
+    int waiting;
+    uint64_t commitSeq;
+    size_t commitReply;     // offset in out of the reply held for the commit
+    int pendingStudent;
+    uint64_t loginStart;    // metricStart() of the pending LOGIN
+    char password[PASSWORD_LENGTH];
+    unsigned char salt[SALT_LENGTH];
+    KdfJob job;
+    Arena scratch;          // reset after every request
+    struct Session *nextWaiting;
+} Session;
+
+static Session **sessions = NULL;   // indexed by fd
+static int sessionCap = 0;
+static Session *waitingSessions = NULL;
+static int serverEpoll = -1;
+static volatile sig_atomic_t serverStop = 0;
+
+static void serverSignal(int sig) {
+    (void)sig;
+    serverStop = 1;
+}
+
+// Lifts the soft descriptor limit to the hard one so thousands of
+// connections fit.
+static void raiseFileLimit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// An address containing '/' is a Unix socket path; anything else is a TCP
+// port on the loopback interface.
+static int serverSocketAddress(const char *address, struct sockaddr_storage *sa, socklen_t *len) {
+    memset(sa, 0, sizeof(*sa));
+    if (strchr(address, '/')) {
+        struct sockaddr_un *un = (struct sockaddr_un *)sa;
+        if (strlen(address) >= sizeof(un->sun_path)) return -1;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address);
+        *len = sizeof(*un);
+        return AF_UNIX;
+    }
+    int port = atoi(address);
+    if (port <= 0 || port > 65535) return -1;
+    struct sockaddr_in *in = (struct sockaddr_in *)sa;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)port);
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    *len = sizeof(*in);
+    return AF_INET;
+}
+
+static int serverListen(const char *address) {
+    struct sockaddr_storage sa;
+    socklen_t len;
+    int family = serverSocketAddress(address, &sa, &len);
+    if (family < 0) {
+        fprintf(stderr, "[!] Invalid server address '%s'\n", address);
+        return -1;
+    }
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    if (family == AF_UNIX) unlink(address);
+    else setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&sa, len) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(address);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void sessionPrintf(Session *ss, const char *fmt, ...) {
+    va_list ap;
+    while (1) {
+        size_t room = ss->outCap - ss->outLen;
+        va_start(ap, fmt);
+        int n = vsnprintf(ss->out + ss->outLen, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            ss->outLen += (size_t)n;
+            return;
+        }
+        ss->outCap = ss->outCap ? ss->outCap * 2 : 1024;
+        while (ss->outCap - ss->outLen <= (size_t)n) ss->outCap *= 2;
+        ss->out = xrealloc(ss->out, ss->outCap);
+    }
+}
+
+static void sessionWatch(Session *ss, int wantWrite) {
+    struct epoll_event ev = { .events = EPOLLIN | (wantWrite ? EPOLLOUT : 0), .data.fd = ss->fd };
+    epoll_ctl(serverEpoll, EPOLL_CTL_MOD, ss->fd, &ev);
+}
+
+static void sessionFree(Session *ss) {
+    sessions[ss->fd] = NULL;
+    close(ss->fd);
+    free(ss->out);
+    arenaReset(&ss->scratch, 1);
+    free(ss);
+}
+
+// Starts closing a session. One with a KDF job still queued is freed once
+// the job finishes, since the pool writes into it.
+static void sessionClose(Session *ss) {
+    if (ss->closing > 0) return;
+    ss->closing = 1;
+    epoll_ctl(serverEpoll, EPOLL_CTL_DEL, ss->fd, NULL);
+    if (ss->waiting != WAIT_KDF) {
+        if (ss->waiting == WAIT_COMMIT) ss->waiting = WAIT_NONE;   // dropped from the list on the next wake
+        else sessionFree(ss);
+    }
+}
+
+// Sends buffered output. Responses are held while a commit is pending.
+static void sessionFlush(Session *ss) {
+    if (ss->closing > 0 || ss->waiting == WAIT_COMMIT) return;
+    while (ss->outSent < ss->outLen) {
+        ssize_t n = send(ss->fd, ss->out + ss->outSent, ss->outLen - ss->outSent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            sessionClose(ss);
+            return;
+        }
+        ss->outSent += (size_t)n;
+    }
+    if (ss->outSent == ss->outLen) ss->outSent = ss->outLen = 0;
+    if (ss->closing < 0 && ss->outLen == 0) sessionClose(ss);
+    else sessionWatch(ss, ss->outLen > 0);
+}
+
+static void sessionWait(Session *ss, int what) {
+    ss->waiting = what;
+    ss->nextWaiting = waitingSessions;
+    waitingSessions = ss;
+}
+
+// Replies OK once journal record 'seq' is durable; serverWake swaps the reply
+// for an error if the journal cannot be written.
+static void sessionAwaitCommit(Session *ss, uint64_t seq) {
+    ss->commitReply = ss->outLen;
+    sessionPrintf(ss, "OK 0\n");
+    ss->commitSeq = seq;
+    sessionWait(ss, WAIT_COMMIT);
+}
+
+static void serverLogin(Session *ss, char *args, int admin) {
+    char *password = strchr(args, ' ');
+    if (!password) {
+        sessionPrintf(ss, "ERR usage: %s user password\n", admin ? "ADMIN" : "LOGIN");
+        return;
+    }
+    *password++ = '\0';
+    if (admin) {
+        ss->admin = validateAdminLogin(args, password);
+        sessionPrintf(ss, ss->admin ? "OK 0\n" : "ERR invalid credentials\n");
+        return;
+    }
+    ss->loginStart = metricStart();
+    pthread_rwlock_rdlock(&stateLock);
+    int i = findStudent(args);
+    if (i >= 0) {
+        memcpy(ss->salt, students[i].salt, SALT_LENGTH);
+        ss->job.iterations = students[i].kdfIterations;
+    }
+    pthread_rwlock_unlock(&stateLock);
+    if (i < 0) {
+        metricEnd(METRIC_LOGIN, ss->loginStart, 0);
+        sessionPrintf(ss, "ERR invalid credentials\n");
+        return;
+    }
+    if (verifyCacheCheck(i, password)) {
+        metricEnd(METRIC_LOGIN, ss->loginStart, 1);
+        ss->student = i;
+        sessionPrintf(ss, "OK 0\n");
+        return;
+    }
+    snprintf(ss->password, sizeof(ss->password), "%s", password);
+    ss->pendingStudent = i;
+    ss->job.password = ss->password;
+    ss->job.salt = ss->salt;
+    kdfSubmit(&ss->job);
+    sessionWait(ss, WAIT_KDF);
+}
+
+static void serverLoginDone(Session *ss) {
+    int i = ss->pendingStudent;
+    int ok = constantTimeEqual(ss->job.out, students[i].passwordHash, HASH_LENGTH);
+    metricEnd(METRIC_LOGIN, ss->loginStart, ok);
+    if (ok) {
+        verifyCacheRemember(i, ss->password);
+        ss->student = i;
+        sessionPrintf(ss, "OK 0\n");
+    } else {
+        sessionPrintf(ss, "ERR invalid credentials\n");
+    }
+    memset(ss->password, 0, sizeof(ss->password));
+}
+
+static void serverSearch(Session *ss, const char *query, int fuzzy) {
+    int *ids = NULL;
+    int n;
+    if (fuzzy) {
+        FuzzyHit *hits;
+        n = searchIndexFuzzy(&ss->scratch, query, FUZZY_TOP_K, &hits);
+        ids = arenaAlloc(&ss->scratch, sizeof(int) * (size_t)(n + 1));
+        for (int i = 0; i < n; i++) ids[i] = hits[i].id;
+    } else {
+        n = searchIndexQuery(&ss->scratch, query, &ids);
+    }
+    int shown = n < SERVER_MAX_RESULTS ? n : SERVER_MAX_RESULTS;
+    sessionPrintf(ss, "OK %d\n", shown);
+    for (int k = 0; k < shown; k++) {
+        int id = ids[k];
+        sessionPrintf(ss, "%u\t%d\t%s\t%s\t%s\n", lib.bookId[id], stockLevel(id),
+                      streamName(lib.subjects[lib.bookSubject[id]].streamId),
+                      subjectName(lib.bookSubject[id]), bookName(id));
+    }
+}
+
+static void serverLoans(Session *ss) {
+    pthread_rwlock_rdlock(&stateLock);
+    lockStudent(ss->student);
+    Student *st = &students[ss->student];
+    sessionPrintf(ss, "OK %d\n", st->loanCount);
+    for (int i = 0; i < st->loanCount; i++) {
+        IssuedBook *ib = &st->loans[i];
+        sessionPrintf(ss, "%d\t%s\t%lld\t%lld\t%s\n", i + 1, ib->isReturned ? "returned" : "issued",
+                      (long long)ib->issueDate, (long long)ib->dueDate, bookNameById(ib->bookId));
+    }
+    unlockStudent(ss->student);
+    pthread_rwlock_unlock(&stateLock);
+}
+
+// HOLDS: the student's holds with their place in the queue, 0 once ready.
+static void serverHolds(Session *ss) {
+    StudentHold *holds;
+    int n = studentHoldsCopy(ss->student, &holds);
+    sessionPrintf(ss, "OK %d\n", n);
+    for (int i = 0; i < n; i++) {
+        StudentHold *h = &holds[i];
+        sessionPrintf(ss, "%u\t%s\t%d\t%lld\t%s\n", h->bookId, h->ready ? "ready" : "waiting",
+                      holdPosition(ss->student, h->bookId), (long long)h->time, bookNameById(h->bookId));
+    }
+    free(holds);
+}
+
+// REPORT cursor [count [filter]]: rows of the log timeline starting at
+// 'cursor'; the status line carries the cursor for the next page.
+static void serverReport(Session *ss, char *args) {
+    int cursor = 0, count = REPORT_PAGE_SIZE, used = 0;
+    sscanf(args, "%d %d %n", &cursor, &count, &used);
+    const char *filter = used ? args + used : "";
+    if (cursor < 0) cursor = 0;
+    if (count < 1 || count > 1000) count = REPORT_PAGE_SIZE;
+
+    int *ids = arenaAlloc(&ss->scratch, sizeof(int) * (size_t)count);
+    LogEntry *rows = arenaAlloc(&ss->scratch, sizeof(LogEntry) * (size_t)count);
+    int shown = 0;
+    pthread_mutex_lock(&historyLock);
+    buildLogIndex();
+    const Timeline *t = &logIdx.all;
+    if (*filter) {
+        t = logIndexFilter(filter);
+    }
+    while (t && shown < count && cursor + shown < t->count) {
+        ids[shown] = t->entries[cursor + shown].logIndex;
+        readLog(ids[shown], &rows[shown]);
+        shown++;
+    }
+    pthread_mutex_unlock(&historyLock);
+
+    sessionPrintf(ss, "OK %d %d\n", shown, cursor + shown);
+    for (int k = 0; k < shown; k++) {
+        const LogEntry *e = &rows[k];
+        sessionPrintf(ss, "%d\t%lld\t%s\t%s\t%s\n", ids[k] + 1, (long long)e->timestamp,
+                      e->action, e->username, bookNameById(e->bookId));
+    }
+}
+
+// STATS: the stats command's rows for the running server.
+static void serverStats(Session *ss) {
+    pthread_mutex_lock(&historyLock);
+    sessionPrintf(ss, "OK %d\n", ARENA_KINDS);
+    for (int k = 0; k < ARENA_KINDS; k++) {
+        const ArenaStats *as = &arenaStats[k];
+        sessionPrintf(ss, "%s\t%llu\t%zu\t%zu\t%zu\t%llu\n", as->name, (unsigned long long)as->allocs,
+                      as->used, as->peak, as->reserved, (unsigned long long)as->resets);
+    }
+    pthread_mutex_unlock(&historyLock);
+}
+
+static void serverRequest(Session *ss, char *line) {
+    char *args = strchr(line, ' ');
+    if (args) *args++ = '\0';
+    else args = line + strlen(line);
+
+    if (strcmp(line, "PING") == 0) {
+        sessionPrintf(ss, "OK 0\n");
+    } else if (strcmp(line, "LOGIN") == 0 || strcmp(line, "ADMIN") == 0) {
+        serverLogin(ss, args, line[0] == 'A');
+    } else if (strcmp(line, "SEARCH") == 0 || strcmp(line, "FUZZY") == 0) {
+        serverSearch(ss, args, line[0] == 'F');
+    } else if (strcmp(line, "QUIT") == 0) {
+        sessionPrintf(ss, "OK 0\n");
+        ss->closing = -1;   // close once the reply is sent
+    } else if (strcmp(line, "REPORT") == 0) {
+        if (ss->admin) serverReport(ss, args);
+        else sessionPrintf(ss, "ERR admin login required\n");
+    } else if (strcmp(line, "STATS") == 0) {
+        if (ss->admin) serverStats(ss);
+        else sessionPrintf(ss, "ERR admin login required\n");
+    } else if (ss->student < 0 && (strcmp(line, "ISSUE") == 0 || strcmp(line, "RETURN") == 0 ||
+                                   strcmp(line, "LOANS") == 0 || strcmp(line, "HOLD") == 0 ||
+                                   strcmp(line, "UNHOLD") == 0 || strcmp(line, "HOLDS") == 0)) {
+        sessionPrintf(ss, "ERR login required\n");
+    } else if (strcmp(line, "LOANS") == 0) {
+        serverLoans(ss);
+    } else if (strcmp(line, "HOLDS") == 0) {
+        serverHolds(ss);
+    } else if (strcmp(line, "HOLD") == 0 || strcmp(line, "UNHOLD") == 0) {
+        int id = catalogRowById((uint32_t)strtoul(args, NULL, 10));
+        uint64_t seq;
+        const char *err = line[0] == 'H' ? placeHold(ss->student, id, &seq)
+                        : cancelHold(ss->student, id, &seq) != 0 ? "not on hold" : NULL;
+        if (err) {
+            sessionPrintf(ss, "ERR %s\n", err);
+        } else {
+            sessionAwaitCommit(ss, seq);
+        }
+    } else if (strcmp(line, "ISSUE") == 0) {
+        int id = catalogRowById((uint32_t)strtoul(args, NULL, 10));
+        uint64_t seq;
+        if (id < 0) {
+            sessionPrintf(ss, "ERR no such book\n");
+        } else if (issueCopy(ss->student, id, &seq) < 0) {
+            sessionPrintf(ss, "ERR not available\n");
+        } else {
+            sessionAwaitCommit(ss, seq);
+        }
+    } else if (strcmp(line, "RETURN") == 0) {
+        uint64_t seq;
+        if (returnCopy(ss->student, atoi(args) - 1, &seq) != 0) {
+            sessionPrintf(ss, "ERR no such loan\n");
+        } else {
+            sessionAwaitCommit(ss, seq);
+        }
+    } else {
+        sessionPrintf(ss, "ERR unknown command\n");
+    }
+}
+
+// Handles buffered request lines until one has to wait.
+static void sessionProcess(Session *ss) {
+    int start = 0;
+    while (ss->waiting == WAIT_NONE && ss->closing == 0) {
+        char *nl = memchr(ss->in + start, '\n', (size_t)(ss->inLen - start));
+        if (!nl) break;
+        *nl = '\0';
+        if (nl > ss->in + start && nl[-1] == '\r') nl[-1] = '\0';
+        serverRequest(ss, ss->in + start);
+        arenaReset(&ss->scratch, 0);
+        start = (int)(nl - ss->in) + 1;
+    }
+    memmove(ss->in, ss->in + start, (size_t)(ss->inLen - start));
+    ss->inLen -= start;
+    if (ss->waiting == WAIT_NONE && ss->inLen == SERVER_INPUT_LENGTH) {
+        sessionPrintf(ss, "ERR request too long\n");
+        ss->closing = -1;
+    }
+}
+
+static void sessionReadable(Session *ss) {
+    while (ss->inLen < SERVER_INPUT_LENGTH) {
+        ssize_t n = recv(ss->fd, ss->in + ss->inLen, (size_t)(SERVER_INPUT_LENGTH - ss->inLen), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            sessionClose(ss);
+            return;
+        }
+        ss->inLen += (int)n;
+    }
+    sessionProcess(ss);
+}
+
+// Finishes a request that was waiting, then carries on with the session.
+static void sessionResume(Session *ss) {
+    if (ss->closing > 0) {
+        sessionFree(ss);
+        return;
+    }
+    sessionProcess(ss);
+    sessionFlush(ss);
+}
+
+// Called when the KDF pool or the journal flusher pokes the eventfd.
+static void serverWake() {
+    int failed;
+    uint64_t durable = journalDurableSequence(&failed);
+    Session *list = waitingSessions;
+    waitingSessions = NULL;
+    while (list) {
+        Session *ss = list;
+        list = ss->nextWaiting;
+        if (ss->waiting == WAIT_KDF && kdfJobDone(&ss->job)) {
+            ss->waiting = WAIT_NONE;
+            if (ss->closing <= 0) serverLoginDone(ss);
+            sessionResume(ss);
+        } else if (ss->waiting == WAIT_COMMIT && (ss->commitSeq <= durable || failed)) {
+            ss->waiting = WAIT_NONE;
+            if (ss->commitSeq > durable) {
+                ss->outLen = ss->commitReply;
+                sessionPrintf(ss, "ERR could not save to the journal\n");
+            }
+            sessionResume(ss);
+        } else if (ss->waiting == WAIT_NONE) {
+            sessionFree(ss);    // closed while its commit was pending
+        } else {
+            ss->nextWaiting = waitingSessions;
+            waitingSessions = ss;
+        }
+    }
+}
+
+static void serverAccept(int listenFd) {
+    while (1) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (fd >= sessionCap) {
+            int newCap = sessionCap ? sessionCap : 1024;
+            while (newCap <= fd) newCap *= 2;
+            sessions = xrealloc(sessions, sizeof(Session *) * (size_t)newCap);
+            memset(sessions + sessionCap, 0, sizeof(Session *) * (size_t)(newCap - sessionCap));
+            sessionCap = newCap;
+        }
+        Session *ss = calloc(1, sizeof(Session));
+        if (!ss) {
+            close(fd);
+            continue;
+        }
+        ss->fd = fd;
+        ss->student = -1;
+        ss->scratch = (Arena){ .blockSize = SERVER_SCRATCH_SIZE, .stats = &arenaStats[ARENA_SESSION] };
+        sessions[fd] = ss;
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(serverEpoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+// Serves requests until SIGINT or SIGTERM.
+int runServer(const char *address) {
+    raiseFileLimit();
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa = { .sa_handler = serverSignal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int listenFd = serverListen(address);
+    if (listenFd < 0) return 1;
+    int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    serverEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (wakeFd < 0 || serverEpoll < 0) {
+        perror("epoll");
+        return 1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = listenFd };
+    epoll_ctl(serverEpoll, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.fd = wakeFd;
+    epoll_ctl(serverEpoll, EPOLL_CTL_ADD, wakeFd, &ev);
+    kdfSetNotify(wakeFd);
+    journalSetNotify(wakeFd);
+    printf("[+] Serving on %s\n", address);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!serverStop) {
+        int n = epoll_wait(serverEpoll, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            int fd = events[k].data.fd;
+            if (fd == listenFd) {
+                serverAccept(listenFd);
+            } else if (fd == wakeFd) {
+                uint64_t count;
+                if (read(wakeFd, &count, sizeof(count)) < 0) { /* spurious wakeup */ }
+                serverWake();
+            } else if (fd < sessionCap && sessions[fd]) {
+                Session *ss = sessions[fd];
+                if (events[k].events & (EPOLLHUP | EPOLLERR)) {
+                    sessionClose(ss);
+                    continue;
+                }
+                if (events[k].events & EPOLLIN) sessionReadable(ss);
+                if (sessions[fd] == ss && ss->closing <= 0) sessionFlush(ss);
+            }
+        }
+    }
+
+    kdfSetNotify(-1);
+    journalSetNotify(-1);
+    close(listenFd);
+    if (strchr(address, '/')) unlink(address);
+    printf("\n[+] Server stopped.\n");
+    return 0;
+}
+
+// --- Benchmarks ---
+int benchCatalogLoad(int titles) {
+    const char *path = "bench_catalog.csv";
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    srand(42);
+    fprintf(fp, "stream,subject,title,quantity\n");
+    for (int i = 0; i < titles; i++) {
+        int stream = i / (titles / 20 + 1);
+        int subject = i / (titles / 400 + 1);
+        fprintf(fp, "Stream %d,Subject %d,\"Synthetic Title %d, Volume %d\",%d\n",
+            stream, subject, i, rand() % 12 + 1, rand() % 20);
+    }
+    fclose(fp);
+
+    int errors = 0;
+    double start = nowMs();
+    int loaded = loadCatalogFile(path, &errors);
+    double elapsed = nowMs() - start;
+    remove(path);
+
+    printf("catalog load: %d titles, %d errors, %.2f ms (budget %.0f ms)\n",
+        loaded, errors, elapsed, CATALOG_LOAD_BUDGET_MS);
+    const ArenaStats *as = &arenaStats[ARENA_CATALOG];
+    printf("  catalog arena: %llu allocations, peak %zu KB in %zu KB of blocks\n",
+        (unsigned long long)as->allocs, as->peak / 1024, as->reserved / 1024);
+    if (loaded != titles || errors) {
+        printf("[!] loaded %d of %d titles\n", loaded, titles);
+        return 1;
+    }
+    if (elapsed > CATALOG_LOAD_BUDGET_MS) {
+        printf("[!] catalog load exceeded its startup budget\n");
+        return 1;
+    }
+    return 0;
+}
+
+// The byte-at-a-time search the kernels replaced, kept as the baseline.
+static char *strcasestrBaseline(const char *haystack, const char *needle) {
+    if (!*needle) return (char *) haystack;
+    for (; *haystack; haystack++) {
+        if (tolower((unsigned char)*haystack) == tolower((unsigned char)*needle)) {
+            const char *h, *n;
+            for (h = haystack, n = needle; *h && *n; h++, n++) {
+                if (tolower((unsigned char)*h) != tolower((unsigned char)*n))
+                    break;
+            }
+            if (!*n)
+                return (char *) haystack;
         }
     }
+    return NULL;
 }
 
-void loginSystem() {
-    while (1) {
-        printHeader("Library Management System");
-        printf("1. Admin Login\n");
-        printf("2. Student Login\n");
-        printf("3. Student Signup\n");
-        printf("4. Exit\n");
-        printf("\nEnter choice: ");
-        int choice;
-        scanf("%d", &choice);
-        clearInput();
-        if(choice == 1){
-            char adminUser[50], adminPass[PASSWORD_LENGTH];
-            printHeader("Admin Login");
-            printf("Admin username: ");
-            fgets(adminUser, sizeof(adminUser), stdin);
-            adminUser[strcspn(adminUser, "\n")] = 0;
+// Words for synthetic titles.
+static const char *benchWords[] = {
+    "Introduction", "to", "Operating", "Systems", "Data", "Structures", "Algorithms",
+    "Advanced", "Database", "Concepts", "Computer", "Networks", "Principles", "of",
+    "Marketing", "Financial", "Accounting", "Modern", "Java", "Programming", "Theory",
+    "Applied", "Mathematics", "Engineering", "Microprocessor", "Architecture", "Design",
+    "Analysis", "Management", "Economics", "Statistics", "Handbook", "Volume", "Edition"
+};
+#define BENCH_WORD_COUNT ((int)(sizeof(benchWords) / sizeof(benchWords[0])))
 
-            printf("Admin password: ");
-            getPassword(adminPass, PASSWORD_LENGTH);
+int benchSubstring(int titles) {
+    static const char *queries[] = { "operating", "sys", "JAVA", "edition 3", "zzz", "networks", "o" };
+    const int queryCount = (int)(sizeof(queries) / sizeof(queries[0]));
+    const int rounds = 5;
 
-            if (strcmp(adminUser, "admin") == 0 && strcmp(adminPass, "Admin@123") == 0) {
-                printf("\nAdmin login successful.\n");
-                waitForEnter();
-                adminMenu();
-            } else {
-                printf("\n[!] Invalid admin credentials.\n");
-                waitForEnter();
-            }
+    srand(7);
+    char **corpus = xrealloc(NULL, sizeof(char *) * (size_t)titles);
+    size_t *lengths = xrealloc(NULL, sizeof(size_t) * (size_t)titles);
+    size_t bytes = 0;
+    for (int i = 0; i < titles; i++) {
+        char title[CATALOG_FIELD_LENGTH] = "";
+        int n = 3 + rand() % 6;
+        for (int w = 0; w < n; w++) {
+            const char *word = benchWords[rand() % BENCH_WORD_COUNT];
+            if (strlen(title) + strlen(word) + 2 >= sizeof(title)) break;
+            if (w) strcat(title, " ");
+            strcat(title, word);
         }
-        else if(choice == 2){
-            int sIndex = studentLogin();
-            if(sIndex != -1)
-                studentMenu(sIndex);
+        if (rand() % 4 == 0)
+            snprintf(title + strlen(title), sizeof(title) - strlen(title), " Edition %d", rand() % 9 + 1);
+        corpus[i] = strdup(title);
+        lengths[i] = strlen(title);
+        bytes += lengths[i];
+    }
+
+    printf("substring search: %d titles, %.1f KiB, %d queries x %d rounds, kernel %s\n",
+        titles, bytes / 1024.0, queryCount, rounds, substringKernelName());
+
+    long baselineHits = 0, kernelHits = 0;
+    double start = nowMs();
+    for (int r = 0; r < rounds; r++)
+        for (int q = 0; q < queryCount; q++)
+            for (int i = 0; i < titles; i++)
+                if (strcasestrBaseline(corpus[i], queries[q])) baselineHits++;
+    double baselineMs = nowMs() - start;
+
+    start = nowMs();
+    for (int r = 0; r < rounds; r++)
+        for (int q = 0; q < queryCount; q++) {
+            size_t qlen = strlen(queries[q]);
+            for (int i = 0; i < titles; i++)
+                if (findCaseInsensitive(corpus[i], lengths[i], queries[q], qlen)) kernelHits++;
         }
-        else if(choice == 3){
-            signup();
+    double kernelMs = nowMs() - start;
+
+    double scans = (double)rounds * queryCount * titles;
+    printf("  baseline  %8.2f ms  %6.1f ns/title\n", baselineMs, baselineMs * 1e6 / scans);
+    printf("  %-8s  %8.2f ms  %6.1f ns/title  (%.2fx)\n", substringKernelName(),
+        kernelMs, kernelMs * 1e6 / scans, baselineMs / (kernelMs > 0 ? kernelMs : 1e-9));
+
+    for (int i = 0; i < titles; i++) free(corpus[i]);
+    free(corpus);
+    free(lengths);
+    if (baselineHits != kernelHits) {
+        printf("[!] result mismatch: baseline %ld hits, kernel %ld hits\n", baselineHits, kernelHits);
+        return 1;
+    }
+    return 0;
+}
+
+int benchLogin(int maxStudents) {
+    const int lookups = 200000;
+    char username[50];
+    printf("student directory: %d username lookups per directory size\n", lookups);
+    printf("  %10s  %12s  %10s\n", "students", "build ms", "ns/lookup");
+    for (int size = 100; size <= maxStudents; size *= 10) {
+        studentCount = 0;
+        rebuildStudentIndex();
+        double start = nowMs();
+        for (int i = 0; i < size; i++) {
+            snprintf(username, sizeof(username), "student%07d", i);
+            addStudent(username);
         }
-        else if(choice == 4){
+        double buildMs = nowMs() - start;
+
+        srand(11);
+        int failures = 0;
+        start = nowMs();
+        for (int i = 0; i < lookups; i++) {
+            snprintf(username, sizeof(username), "student%07d", rand() % size);
+            if (findStudent(username) < 0) failures++;
+        }
+        double loginMs = nowMs() - start;
+        printf("  %10d  %12.2f  %10.1f\n", size, buildMs, loginMs * 1e6 / lookups);
+        if (failures) {
+            printf("[!] %d lookups failed\n", failures);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int benchKdf(int threads) {
+    static const int costs[] = { 1000, 10000, 100000 };
+    const int logins = 32;
+    kdfStartPool(threads);
+    studentCount = 0;
+    rebuildStudentIndex();
+    int id = addStudent("bench");
+
+    printf("password verification: %d concurrent logins, %d KDF worker(s)\n", logins, threads);
+    printf("  %12s  %12s  %10s\n", "iterations", "logins/s", "ms/login");
+    KdfJob *jobs = xrealloc(NULL, sizeof(KdfJob) * (size_t)logins);
+    for (size_t c = 0; c < sizeof(costs) / sizeof(costs[0]); c++) {
+        config.kdfIterations = costs[c];
+        setStudentPassword(id, "Bench@Pass1");
+        double start = nowMs();
+        for (int i = 0; i < logins; i++) {
+            jobs[i] = (KdfJob){ .password = "Bench@Pass1", .salt = students[id].salt,
+                                .iterations = students[id].kdfIterations };
+            kdfSubmit(&jobs[i]);
+        }
+        int failures = 0;
+        for (int i = 0; i < logins; i++) {
+            kdfWait(&jobs[i]);
+            if (!constantTimeEqual(jobs[i].out, students[id].passwordHash, HASH_LENGTH)) failures++;
+        }
+        double elapsed = nowMs() - start;
+        printf("  %12d  %12.1f  %10.2f\n", costs[c], logins * 1000.0 / elapsed, elapsed / logins);
+        if (failures) {
+            free(jobs);
+            printf("[!] %d verifications failed\n", failures);
+            return 1;
+        }
+    }
+    free(jobs);
+
+    verifyStudentPassword(id, "Bench@Pass1");
+    const int cachedLogins = 100000;
+    double start = nowMs();
+    for (int i = 0; i < cachedLogins; i++) verifyStudentPassword(id, "Bench@Pass1");
+    double elapsed = nowMs() - start;
+    printf("  %12s  %12.1f  %10.4f\n", "cached", cachedLogins * 1000.0 / elapsed, elapsed / cachedLogins);
+    return 0;
+}
+
+// Runs a benchmark inside a fresh temporary directory so anything it
+// persists (log segments, snapshots, the journal) never touches the real
+// data files.
+static char benchHome[4096];
+static char benchDir[64];
+
+static int benchEnterScratch() {
+    strcpy(benchDir, "/tmp/library-bench-XXXXXX");
+    if (!getcwd(benchHome, sizeof(benchHome)) || !mkdtemp(benchDir) || chdir(benchDir) != 0) {
+        perror("bench scratch directory");
+        return -1;
+    }
+    return 0;
+}
+
+static void benchRemoveFiles(const char *dirPath) {
+    DIR *dir = opendir(dirPath);
+    struct dirent *ent;
+    char path[300];
+    while (dir && (ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dirPath, ent->d_name);
+        unlink(path);
+    }
+    if (dir) closedir(dir);
+}
+
+static void benchLeaveScratch() {
+    syncLogStore();
+    benchRemoveFiles(LOG_DIR);
+    rmdir(LOG_DIR);
+    benchRemoveFiles(".");
+    if (chdir(benchHome) == 0) rmdir(benchDir);
+}
+
+typedef struct {
+    int seed;
+    int ops;
+    int studentCount;
+    int issued, returned, refused;
+} StressWorker;
+
+// Each worker issues to random students and returns copies it holds, so
+// all workers keep competing for the same few copies.
+static void *stressWorker(void *arg) {
+    StressWorker *w = arg;
+    unsigned seed = (unsigned)w->seed;
+    int held[8][2], heldCount = 0;
+    for (int k = 0; k < w->ops; k++) {
+        uint64_t seq;
+        if (heldCount == 0 || (heldCount < 8 && (rand_r(&seed) & 1))) {
+            int st = (int)(rand_r(&seed) % (unsigned)w->studentCount);
+            int slot = issueCopy(st, 0, &seq);
+            if (slot < 0) {
+                w->refused++;
+                continue;
+            }
+            held[heldCount][0] = st;
+            held[heldCount][1] = slot;
+            heldCount++;
+            w->issued++;
+        } else {
+            int h = (int)(rand_r(&seed) % (unsigned)heldCount);
+            if (returnCopy(held[h][0], held[h][1], &seq) == 0) w->returned++;
+            held[h][0] = held[heldCount - 1][0];
+            held[h][1] = held[heldCount - 1][1];
+            heldCount--;
+        }
+    }
+    return NULL;
+}
+
+// Many threads issue and return one scarce title; afterwards the stock on
+// the shelf plus the copies on loan must equal what the library owns.
+int benchStress(int threads, int copies, int opsPerThread) {
+    if (benchEnterScratch() != 0) return 1;
+    loadLogStore();
+    int book = catalogAddBook(catalogAddSubject(catalogAddStream("Stress"), "Contention"), "Popular Title", copies, 1);
+    studentCount = 0;
+    rebuildStudentIndex();
+    // Each worker holds at most eight loans; spread them over enough
+    // students that the loan limit seldom refuses an issue.
+    int studentTotal = threads * 8;
+    char username[50];
+    for (int i = 0; i < studentTotal; i++) {
+        snprintf(username, sizeof(username), "stress%07d", i);
+        addStudent(username);
+    }
+
+    StressWorker *workers = calloc((size_t)threads, sizeof(StressWorker));
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    printf("stress: %d threads x %d operations on one title with %d copies, %d students\n",
+           threads, opsPerThread, copies, studentTotal);
+    double start = nowMs();
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (StressWorker){ .seed = 7 + t, .ops = opsPerThread, .studentCount = studentTotal };
+        pthread_create(&tids[t], NULL, stressWorker, &workers[t]);
+    }
+    int issued = 0, returned = 0, refused = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        issued += workers[t].issued;
+        returned += workers[t].returned;
+        refused += workers[t].refused;
+    }
+    double elapsed = nowMs() - start;
+
+    int onLoan = 0;
+    for (int i = 0; i < studentCount; i++) onLoan += students[i].activeCount;
+    int shelf = stockLevel(book);
+    DueEntry *due;
+    int dueCount = dueIndexOverdue(&reportArena, (time_t)INT64_MAX, &due, NULL);
+    arenaReset(&reportArena, 0);
+    printf("  issued %d, returned %d, refused %d in %.1f ms (%.0f ops/s)\n",
+           issued, returned, refused, elapsed, (issued + returned + refused) * 1000.0 / elapsed);
+    printf("  on shelf %d + on loan %d = %d of %d copies\n", shelf, onLoan, shelf + onLoan, copies);
+    printf("  log entries %d, due-date index entries %d\n", logCount, dueCount);
+    benchLeaveScratch();
+    free(workers);
+    free(tids);
+
+    int ok = shelf >= 0 && onLoan == issued - returned && shelf + onLoan == copies &&
+             logCount == issued + returned && dueCount == onLoan;
+    printf(ok ? "[+] Inventory consistent\n" : "[!] Inventory mismatch\n");
+    return ok ? 0 : 1;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    int fd;
+    char in[SERVER_INPUT_LENGTH];
+    int inLen;
+    double sentAt;
+} LoadClient;
+
+// Returns the length of the first complete response in buf, or 0 if more
+// bytes are needed.
+static int responseLength(const char *buf, int len) {
+    const char *nl = memchr(buf, '\n', (size_t)len);
+    if (!nl) return 0;
+    int rows = 0;
+    if (strncmp(buf, "OK ", 3) == 0) rows = atoi(buf + 3);
+    const char *p = nl + 1;
+    for (; rows > 0; rows--) {
+        nl = memchr(p, '\n', (size_t)(buf + len - p));
+        if (!nl) return 0;
+        p = nl + 1;
+    }
+    return (int)(p - buf);
+}
+
+// Closed-loop load generator: every connection keeps one request in flight
+// until 'requests' responses have arrived.
+int benchServer(const char *address, int connections, int requests, const char *request) {
+    struct sockaddr_storage sa;
+    socklen_t saLen;
+    int family = serverSocketAddress(address, &sa, &saLen);
+    if (family < 0) {
+        fprintf(stderr, "[!] Invalid server address '%s'\n", address);
+        return 2;
+    }
+    raiseFileLimit();
+    signal(SIGPIPE, SIG_IGN);
+
+    char line[SERVER_INPUT_LENGTH];
+    int lineLen = snprintf(line, sizeof(line), "%s\n", request);
+    LoadClient *clients = calloc((size_t)connections, sizeof(LoadClient));
+    double *latency = malloc(sizeof(double) * (size_t)requests);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (!clients || !latency || ep < 0) {
+        fprintf(stderr, "[!] Out of memory\n");
+        return 1;
+    }
+    for (int c = 0; c < connections; c++) {
+        int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&sa, saLen) != 0) {
+            perror(address);
+            return 1;
+        }
+        int one = 1;
+        if (family == AF_INET) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients[c].fd = fd;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)c };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    printf("Load test: %d connections, %d requests of '%s'\n", connections, requests, request);
+    int sent = 0, received = 0, errors = 0;
+    double start = nowMs();
+    for (int c = 0; c < connections && sent < requests; c++, sent++) {
+        clients[c].sentAt = nowMs();
+        if (send(clients[c].fd, line, (size_t)lineLen, MSG_NOSIGNAL) != lineLen) errors++;
+    }
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (received < sent) {
+        int n = epoll_wait(ep, events, SERVER_MAX_EVENTS, 5000);
+        if (n == 0) {
+            fprintf(stderr, "[!] Server stopped answering after %d responses\n", received);
             break;
         }
-        else{
-            printf("\n[!] Invalid choice.\n");
-            waitForEnter();
+        for (int k = 0; k < n; k++) {
+            LoadClient *cl = &clients[events[k].data.u32];
+            ssize_t got = recv(cl->fd, cl->in + cl->inLen, sizeof(cl->in) - (size_t)cl->inLen, 0);
+            if (got <= 0) {
+                fprintf(stderr, "[!] Connection closed by server\n");
+                return 1;
+            }
+            cl->inLen += (int)got;
+            int used;
+            while ((used = responseLength(cl->in, cl->inLen)) > 0) {
+                if (strncmp(cl->in, "OK", 2) != 0) errors++;
+                latency[received++] = nowMs() - cl->sentAt;
+                memmove(cl->in, cl->in + used, (size_t)(cl->inLen - used));
+                cl->inLen -= used;
+                if (sent < requests) {
+                    cl->sentAt = nowMs();
+                    if (send(cl->fd, line, (size_t)lineLen, MSG_NOSIGNAL) != lineLen) errors++;
+                    sent++;
+                }
+            }
+            if (cl->inLen == (int)sizeof(cl->in)) {
+                fprintf(stderr, "[!] Response too large for the load generator\n");
+                return 1;
+            }
+        }
+    }
+    double elapsed = nowMs() - start;
+
+    for (int c = 0; c < connections; c++) close(clients[c].fd);
+    close(ep);
+    if (received > 0) {
+        qsort(latency, (size_t)received, sizeof(double), compareDoubles);
+        printf("  requests/s  %10.0f\n", received * 1000.0 / elapsed);
+        printf("  p50 ms      %10.3f\n", latency[received / 2]);
+        printf("  p99 ms      %10.3f\n", latency[(int)(received * 0.99)]);
+        printf("  p99.9 ms    %10.3f\n", latency[(int)(received * 0.999)]);
+        printf("  max ms      %10.3f\n", latency[received - 1]);
+    }
+    if (errors) printf("[!] %d requests failed\n", errors);
+    free(latency);
+    free(clients);
+    return received == requests && errors == 0 ? 0 : 1;
+}
+
+// --- Benchmark suite ---
+// Times the core operations against a synthetic library built in a scratch
+// directory. Each operation gets untimed warmup runs and then times every
+// sample on its own, so tails show up as well as means. Results are one row
+// per operation in a fixed order (tab-separated, or JSON lines with --json),
+// so runs from two builds can be compared with diff or a script.
+#define SUITE_CATALOG "suite_catalog.csv"
+#define SUITE_PASSWORD "Bench@Pass1"
+#define SUITE_MAX_SAMPLES 100000
+
+typedef struct {
+    const char *name;
+    int warmup, samples;
+    int (*run)(int i);      // returns 0, or -1 if the operation failed
+} SuiteOp;
+
+static struct {
+    int titles, students, logs;
+    int (*held)[2];         // (student, slot) of loans issued and not yet returned
+    int heldCount, heldNext, heldCap;
+    int holdBook;           // the title the hold runs queue for
+    int holder, holderSlot; // the student who has it out, and their loan
+} suite;
+
+static void suiteUsername(char *out, size_t size, int i) {
+    snprintf(out, size, "student%07d", i);
+}
+
+static int suiteSearchWord(int i) {
+    int *ids;
+    searchIndexQuery(&reportArena, benchWords[i % BENCH_WORD_COUNT], &ids);
+    arenaReset(&reportArena, 0);
+    return 0;
+}
+
+static int suiteSearchPrefix(int i) {
+    char query[32];
+    snprintf(query, sizeof(query), "%.3s %.4s", benchWords[i % BENCH_WORD_COUNT],
+             benchWords[(i / BENCH_WORD_COUNT + 3) % BENCH_WORD_COUNT]);
+    int *ids;
+    searchIndexQuery(&reportArena, query, &ids);
+    arenaReset(&reportArena, 0);
+    return 0;
+}
+
+// Two words of a title with a typo each: a letter dropped from the first and
+// two letters swapped in the second.
+static int suiteSearchFuzzy(int i) {
+    char a[TOKEN_LENGTH], b[TOKEN_LENGTH], query[2 * TOKEN_LENGTH];
+    snprintf(a, sizeof(a), "%s", benchWords[i % BENCH_WORD_COUNT]);
+    snprintf(b, sizeof(b), "%s", benchWords[(i / BENCH_WORD_COUNT + 7) % BENCH_WORD_COUNT]);
+    int la = (int)strlen(a), lb = (int)strlen(b);
+    if (la > 3) memmove(a + la / 2, a + la / 2 + 1, (size_t)(la - la / 2));
+    if (lb > 3) {
+        char c = b[lb / 2];
+        b[lb / 2] = b[lb / 2 - 1];
+        b[lb / 2 - 1] = c;
+    }
+    snprintf(query, sizeof(query), "%s %s", a, b);
+    FuzzyHit *hits;
+    int n = searchIndexFuzzy(&reportArena, query, FUZZY_TOP_K, &hits);
+    arenaReset(&reportArena, 0);
+    return n > 0 ? 0 : -1;
+}
+
+static int suiteLookup(int i) {
+    char username[50];
+    suiteUsername(username, sizeof(username), (int)((i * 7919u) % (unsigned)suite.students));
+    return findStudent(username) >= 0 ? 0 : -1;
+}
+
+// Every sample logs in a different student, so none is served from the
+// verification cache.
+static int suiteLoginKdf(int i) {
+    char username[50];
+    suiteUsername(username, sizeof(username), i + 1);
+    return validateStudentLogin(username, SUITE_PASSWORD) >= 0 ? 0 : -1;
+}
+
+static int suiteLoginCached(int i) {
+    (void)i;
+    return validateStudentLogin("student0000000", SUITE_PASSWORD) >= 0 ? 0 : -1;
+}
+
+static int suiteIssueWith(int i, int commit) {
+    uint64_t seq;
+    int st = (int)((i * 104729u) % (unsigned)suite.students);
+    int id = (int)((i * 7919u) % (unsigned)lib.bookCount);
+    int slot = issueCopy(st, id, &seq);
+    if (slot < 0) return -1;
+    if (commit) journalCommit(seq);
+    if (suite.heldCount == suite.heldCap) {
+        suite.heldCap = suite.heldCap ? suite.heldCap * 2 : 1024;
+        suite.held = xrealloc(suite.held, sizeof(suite.held[0]) * (size_t)suite.heldCap);
+    }
+    suite.held[suite.heldCount][0] = st;
+    suite.held[suite.heldCount][1] = slot;
+    suite.heldCount++;
+    return 0;
+}
+
+// Returns loans in the order they were issued.
+static int suiteReturnWith(int commit) {
+    uint64_t seq;
+    if (suite.heldNext == suite.heldCount) return -1;
+    int *loan = suite.held[suite.heldNext++];
+    if (returnCopy(loan[0], loan[1], &seq) != 0) return -1;
+    if (commit) journalCommit(seq);
+    if (suite.heldNext == suite.heldCount) suite.heldNext = suite.heldCount = 0;
+    return 0;
+}
+
+static int suiteIssue(int i) { return suiteIssueWith(i, 0); }
+static int suiteReturn(int i) { (void)i; return suiteReturnWith(0); }
+static int suiteIssueCommit(int i) { return suiteIssueWith(i, 1); }
+static int suiteReturnCommit(int i) { (void)i; return suiteReturnWith(1); }
+
+static int suiteOverdue(int i) {
+    (void)i;
+    DueEntry *due;
+    long long totalFine;
+    dueIndexOverdue(&reportArena, time(NULL), &due, &totalFine);
+    arenaReset(&reportArena, 0);
+    return 0;
+}
+
+// Takes a copy on even runs and puts it back on odd ones, then brings the
+// browse view up to date, which patches that one row.
+static int suiteBrowsePatch(int i) {
+    int id = (int)(((unsigned)i / 2 * 7919u) % (unsigned)lib.bookCount);
+    if (i % 2 == 0 && !stockTake(id)) return -1;
+    if (i % 2) stockGive(id);
+    browseRelease(browseAcquire());
+    return 0;
+}
+
+static int suiteBrowsePrint(int i) {
+    (void)i;
+    FILE *out = fopen("/dev/null", "w");
+    if (!out) return -1;
+    const BrowseView *view = browseAcquire();
+    fwrite(view->all, 1, view->allLen, out);
+    browseRelease(view);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Renders the view from scratch and checks the patched one matched it.
+static int suiteBrowseRender(int i) {
+    (void)i;
+    const BrowseView *patched = browseAcquire();
+    browseMarkLayout();
+    const BrowseView *fresh = browseAcquire();
+    int rc = patched->allLen == fresh->allLen && memcmp(patched->all, fresh->all, fresh->allLen) == 0 &&
+             patched->bySubjectLen == fresh->bySubjectLen &&
+             memcmp(patched->bySubject, fresh->bySubject, fresh->bySubjectLen) == 0 ? 0 : -1;
+    browseRelease(patched);
+    browseRelease(fresh);
+    return rc;
+}
+
+static int suiteReportBuild(int i) {
+    (void)i;
+    pthread_mutex_lock(&historyLock);
+    buildLogIndex();
+    int ok = logIdx.all.count == logCount;
+    pthread_mutex_unlock(&historyLock);
+    return ok ? 0 : -1;
+}
+
+// The first page of one student's history, as REPORT serves it.
+static int suiteReportPage(int i) {
+    char username[50];
+    suiteUsername(username, sizeof(username), (int)((i * 7919u) % (unsigned)suite.students));
+    LogEntry rows[REPORT_PAGE_SIZE];
+    int shown = 0;
+    pthread_mutex_lock(&historyLock);
+    const Timeline *t = logIndexFilter(username);
+    while (t && shown < REPORT_PAGE_SIZE && shown < t->count) {
+        readLog(t->entries[shown].logIndex, &rows[shown]);
+        shown++;
+    }
+    pthread_mutex_unlock(&historyLock);
+    return 0;
+}
+
+// Students 1, 2, ... queue for one title that student 0 has the only copy of,
+// so the queue grows to the number of samples.
+static int suiteHoldPlace(int i) {
+    uint64_t seq;
+    if (i == 0) {
+        suite.holdBook = lib.bookCount / 2;
+        while (stockLevel(suite.holdBook) > 1) stockTake(suite.holdBook);
+        suite.holder = 0;
+        suite.holderSlot = issueCopy(0, suite.holdBook, &seq);
+        if (suite.holderSlot < 0) return -1;
+    }
+    return placeHold(i + 1, suite.holdBook, &seq) ? -1 : 0;
+}
+
+// The holder returns the copy, it is set aside for the front of the queue,
+// and that student borrows it.
+static int suiteHoldCycle(int i) {
+    (void)i;
+    uint64_t seq;
+    if (returnCopy(suite.holder, suite.holderSlot, &seq) != 0) return -1;
+    suite.holder++;
+    suite.holderSlot = issueCopy(suite.holder, suite.holdBook, &seq);
+    return suite.holderSlot >= 0 && stockLevel(suite.holdBook) == 0 ? 0 : -1;
+}
+
+static int suiteSnapshot(int i) {
+    (void)i;
+    compactJournal();
+    return 0;
+}
+
+static const SuiteOp suiteOps[] = {
+    { "search.word", 100, 5000, suiteSearchWord },
+    { "search.prefix", 100, 5000, suiteSearchPrefix },
+    { "search.fuzzy", 100, 5000, suiteSearchFuzzy },
+    { "student.lookup", 1000, 100000, suiteLookup },
+    { "login.kdf", 2, 20, suiteLoginKdf },
+    { "login.cached", 100, 10000, suiteLoginCached },
+    { "issue", 100, 10000, suiteIssue },
+    { "return", 100, 10000, suiteReturn },
+    { "issue.commit", 10, 200, suiteIssueCommit },
+    { "return.commit", 10, 200, suiteReturnCommit },
+    { "overdue", 10, 200, suiteOverdue },
+    { "browse.patch", 100, 10000, suiteBrowsePatch },
+    { "browse.print", 10, 200, suiteBrowsePrint },
+    { "browse.render", 1, 10, suiteBrowseRender },
+    { "report.build", 0, 1, suiteReportBuild },
+    { "report.page", 100, 10000, suiteReportPage },
+    { "hold.place", 0, 990, suiteHoldPlace },
+    { "hold.cycle", 0, 500, suiteHoldCycle },
+    { "snapshot", 1, 10, suiteSnapshot },
+};
+
+// Prints one result row. Returns 1 if any run failed.
+static int suiteReport(const char *name, double *samples, int n, int errors, int json) {
+    double total = 0;
+    for (int i = 0; i < n; i++) total += samples[i];
+    qsort(samples, (size_t)n, sizeof(double), compareDoubles);
+    double p50 = samples[n / 2], p90 = samples[(int)(n * 0.9)], p99 = samples[(int)(n * 0.99)];
+    if (json) {
+        printf("{\"op\":\"%s\",\"samples\":%d,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f,"
+               "\"p99_us\":%.3f,\"max_us\":%.3f,\"errors\":%d}\n",
+               name, n, total / n, p50, p90, p99, samples[n - 1], errors);
+    } else {
+        printf("%s\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n", name, n, total / n, p50, p90, p99, samples[n - 1]);
+    }
+    fflush(stdout);
+    if (errors) fprintf(stderr, "[!] %s: %d runs failed\n", name, errors);
+    return errors != 0;
+}
+
+static void suiteWriteCatalog(int titles) {
+    FILE *fp = fopen(SUITE_CATALOG, "w");
+    if (!fp) return;
+    fprintf(fp, "stream,subject,title,quantity\n");
+    for (int i = 0; i < titles; i++) {
+        char title[CATALOG_FIELD_LENGTH] = "";
+        int n = 2 + rand() % 4;
+        for (int w = 0; w < n; w++) {
+            if (w) strcat(title, " ");
+            strcat(title, benchWords[rand() % BENCH_WORD_COUNT]);
+        }
+        fprintf(fp, "Stream %d,Subject %d,\"%s, Volume %d\",%d\n",
+                i / (titles / 20 + 1), i / (titles / 400 + 1), title, i, 20 + rand() % 20);
+    }
+    fclose(fp);
+}
+
+// Students share one password hash so setting up thousands costs a single
+// derivation. A tenth of them have a loan that is already overdue.
+static void suiteAddStudents(int count) {
+    char username[50];
+    for (int i = 0; i < count; i++) {
+        suiteUsername(username, sizeof(username), i);
+        addStudent(username);
+    }
+    setStudentPassword(0, SUITE_PASSWORD);
+    time_t now = time(NULL);
+    for (int i = 0; i < count; i++) {
+        memcpy(students[i].salt, students[0].salt, SALT_LENGTH);
+        memcpy(students[i].passwordHash, students[0].passwordHash, HASH_LENGTH);
+        students[i].kdfIterations = students[0].kdfIterations;
+        if (i % 10 == 0) {
+            time_t due = now - (time_t)(1 + rand() % 60) * 24 * 60 * 60;
+            applyIssue(i, lib.bookId[rand() % lib.bookCount], due - BORROW_DAYS * 24 * 60 * 60, due);
+        }
+    }
+}
+
+static void suiteAddLogs(int count) {
+    char username[50];
+    time_t start = time(NULL) - (time_t)count * 60;
+    for (int k = 0; k < count; k++) {
+        int st = rand() % suite.students;
+        suiteUsername(username, sizeof(username), st);
+        addLog(st, username, lib.bookId[rand() % lib.bookCount], k % 2 ? "Returned" : "Issued",
+               start + (time_t)k * 60, 0);
+    }
+}
+
+int benchSuite(int titles, int studentTotal, int logs, int json) {
+    if (benchEnterScratch() != 0) return 1;
+    suite.titles = titles;
+    suite.students = studentTotal;
+    suite.logs = logs;
+    // Issues spread over at least 1000 students; keep the loan limit out of
+    // the way so every run measures a successful issue.
+    if (config.maxLoans < 16) config.maxLoans = 16;
+    srand(20);
+    suiteWriteCatalog(titles);
+    kdfStartPool(config.kdfThreads);
+    loadLogStore();
+    journalOpen();
+
+    if (json) {
+        printf("{\"suite\":{\"titles\":%d,\"students\":%d,\"logs\":%d,\"kdf_iterations\":%d,\"kernel\":\"%s\"}}\n",
+               titles, studentTotal, logs, config.kdfIterations, substringKernelName());
+    } else {
+        printf("# suite\ttitles=%d\tstudents=%d\tlogs=%d\tkdf_iterations=%d\tkernel=%s\n",
+               titles, studentTotal, logs, config.kdfIterations, substringKernelName());
+        printf("op\tsamples\tmean_us\tp50_us\tp90_us\tp99_us\tmax_us\n");
+    }
+    fflush(stdout);
+
+    // Loading can only be timed once; the rest of the setup is not timed.
+    int errors = 0;
+    double t0 = nowMs();
+    int loaded = loadCatalogFile(SUITE_CATALOG, &errors);
+    double loadUs = (nowMs() - t0) * 1000.0;
+    remove(SUITE_CATALOG);
+    int failed = suiteReport("catalog.load", &loadUs, 1, loaded == titles && !errors ? 0 : 1, json);
+    suiteAddStudents(studentTotal);
+    suiteAddLogs(logs);
+
+    double *samples = xrealloc(NULL, sizeof(double) * SUITE_MAX_SAMPLES);
+    for (size_t k = 0; k < sizeof(suiteOps) / sizeof(suiteOps[0]); k++) {
+        const SuiteOp *op = &suiteOps[k];
+        errors = 0;
+        for (int i = 0; i < op->warmup; i++) errors += op->run(i) != 0;
+        for (int i = 0; i < op->samples; i++) {
+            t0 = nowMs();
+            errors += op->run(op->warmup + i) != 0;
+            samples[i] = (nowMs() - t0) * 1000.0;
+        }
+        failed |= suiteReport(op->name, samples, op->samples, errors, json);
+    }
+    free(samples);
+    free(suite.held);
+    benchLeaveScratch();
+    return failed;
+}
+
+int runBenchmark(int argc, char *argv[]) {
+    if (argc >= 1 && strcmp(argv[0], "suite") == 0) {
+        int json = 0, n = 0;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--json") == 0) json = 1;
+            else argv[1 + n++] = argv[i];
         }
+        int titles = n >= 1 ? atoi(argv[1]) : 100000;
+        int studentTotal = n >= 2 ? atoi(argv[2]) : 10000;
+        int logs = n >= 3 ? atoi(argv[3]) : 100000;
+        return benchSuite(titles >= 100 ? titles : 100000, studentTotal >= 1000 ? studentTotal : 10000,
+                          logs >= 0 ? logs : 100000, json);
+    }
+    if (argc >= 2 && strcmp(argv[0], "server") == 0) {
+        int connections = argc >= 3 ? atoi(argv[2]) : 100;
+        int requests = argc >= 4 ? atoi(argv[3]) : 100000;
+        return benchServer(argv[1], connections > 0 ? connections : 100,
+                           requests > 0 ? requests : 100000, argc >= 5 ? argv[4] : "SEARCH data");
+    }
+    if (argc >= 1 && strcmp(argv[0], "stress") == 0) {
+        int threads = argc >= 2 ? atoi(argv[1]) : 8;
+        int copies = argc >= 3 ? atoi(argv[2]) : 5;
+        int ops = argc >= 4 ? atoi(argv[3]) : 100000;
+        return benchStress(threads > 0 ? threads : 8, copies > 0 ? copies : 5, ops > 0 ? ops : 100000);
+    }
+    if (argc >= 1 && strcmp(argv[0], "kdf") == 0) {
+        int threads = argc >= 2 ? atoi(argv[1]) : config.kdfThreads;
+        return benchKdf(threads > 0 ? threads : config.kdfThreads);
     }
-}
\ No newline at end of file
+    if (argc >= 1 && strcmp(argv[0], "login") == 0) {
+        int maxStudents = argc >= 2 ? atoi(argv[1]) : 1000000;
+        return benchLogin(maxStudents >= 100 ? maxStudents : 1000000);
+    }
+    if (argc >= 1 && strcmp(argv[0], "substring") == 0) {
+        int titles = argc >= 2 ? atoi(argv[1]) : 100000;
+        return benchSubstring(titles > 0 ? titles : 100000);
+    }
+    if (argc >= 1 && strcmp(argv[0], "load") == 0) {
+        int titles = argc >= 2 ? atoi(argv[1]) : 100000;
+        return benchCatalogLoad(titles > 0 ? titles : 100000);
+    }
+    fprintf(stderr, "usage: library bench suite [titles [students [log entries]]] [--json]\n"
+                    "       library bench load|substring [titles]\n"
+                    "       library bench login [max students]\n"
+                    "       library bench kdf [threads]\n"
+                    "       library bench stress [threads [copies [operations per thread]]]\n"
+                    "       library bench server address [connections [requests [request]]]\n");
+    return 2;
+}